@@ -0,0 +1,233 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "affine.h"
+
+static unsigned int
+affine_type(const float *m)
+{
+	unsigned int type = 0;
+
+	if (m[2] != 0 || m[5] != 0)
+		type |= AFFINE_TRANSLATE;
+
+	if (m[1] == 0 && m[3] == 0) {
+		if (m[0] != 1 || m[4] != 1)
+			type |= AFFINE_SCALE;
+	} else if (m[0] == 0 && m[4] == 0) {
+		type |= AFFINE_ROTATE;
+		if ((m[1] != 1 && m[1] != -1) || (m[3] != 1 && m[3] != -1))
+			type |= AFFINE_SCALE;
+	} else {
+		type |= AFFINE_OTHER;
+	}
+	return type;
+}
+
+void
+affine_init(struct affine *a)
+{
+	static const float identity[6] = { 1, 0, 0,  0, 1, 0 };
+
+	memcpy(a->m, identity, sizeof(identity));
+	a->type = 0;
+}
+
+void
+affine_set(struct affine *a, const float *m)
+{
+	memcpy(a->m, m, sizeof(a->m));
+	a->type = affine_type(a->m);
+}
+
+/* a <- n * a, that is, n is applied after a */
+void
+affine_multiply(struct affine *a, const struct affine *n)
+{
+	const float *p = n->m;
+	float r[6];
+
+	if (n->type == 0)
+		return;
+
+	if (a->type == 0) {
+		*a = *n;
+		return;
+	}
+
+	if (n->type == AFFINE_TRANSLATE) {
+		a->m[2] += p[2];
+		a->m[5] += p[5];
+		a->type = affine_type(a->m);
+		return;
+	}
+
+	if (!(n->type & (AFFINE_ROTATE | AFFINE_OTHER))) {
+		// axis aligned scale, rows scale independently
+		r[0] = p[0] * a->m[0];
+		r[1] = p[0] * a->m[1];
+		r[2] = p[0] * a->m[2] + p[2];
+		r[3] = p[4] * a->m[3];
+		r[4] = p[4] * a->m[4];
+		r[5] = p[4] * a->m[5] + p[5];
+	} else if (!(n->type & AFFINE_OTHER)) {
+		// axis swap, rows trade places
+		r[0] = p[1] * a->m[3];
+		r[1] = p[1] * a->m[4];
+		r[2] = p[1] * a->m[5] + p[2];
+		r[3] = p[3] * a->m[0];
+		r[4] = p[3] * a->m[1];
+		r[5] = p[3] * a->m[2] + p[5];
+	} else {
+		r[0] = p[0] * a->m[0] + p[1] * a->m[3];
+		r[1] = p[0] * a->m[1] + p[1] * a->m[4];
+		r[2] = p[0] * a->m[2] + p[1] * a->m[5] + p[2];
+		r[3] = p[3] * a->m[0] + p[4] * a->m[3];
+		r[4] = p[3] * a->m[1] + p[4] * a->m[4];
+		r[5] = p[3] * a->m[2] + p[4] * a->m[5] + p[5];
+	}
+	affine_set(a, r);
+}
+
+/* Returns -1 if the map is not invertible, inverse may alias a */
+int
+affine_invert(struct affine *inverse, const struct affine *a)
+{
+	const float *m = a->m;
+	float r[6];
+	double det;
+
+	switch (a->type & ~AFFINE_TRANSLATE) {
+	case 0:
+		r[0] = 1;
+		r[1] = 0;
+		r[2] = -m[2];
+		r[3] = 0;
+		r[4] = 1;
+		r[5] = -m[5];
+		break;
+	case AFFINE_SCALE:
+		if (m[0] == 0 || m[4] == 0)
+			return -1;
+		r[0] = 1 / m[0];
+		r[1] = 0;
+		r[2] = -m[2] / m[0];
+		r[3] = 0;
+		r[4] = 1 / m[4];
+		r[5] = -m[5] / m[4];
+		break;
+	case AFFINE_ROTATE:
+	case AFFINE_ROTATE | AFFINE_SCALE:
+		// x' = b y + c, y' = d x + f
+		if (m[1] == 0 || m[3] == 0)
+			return -1;
+		r[0] = 0;
+		r[1] = 1 / m[3];
+		r[2] = -m[5] / m[3];
+		r[3] = 1 / m[1];
+		r[4] = 0;
+		r[5] = -m[2] / m[1];
+		break;
+	default:
+		det = (double)m[0] * m[4] - (double)m[1] * m[3];
+		if (det == 0)
+			return -1;
+		r[0] = m[4] / det;
+		r[1] = -m[1] / det;
+		r[2] = ((double)m[1] * m[5] - (double)m[4] * m[2]) / det;
+		r[3] = -m[3] / det;
+		r[4] = m[0] / det;
+		r[5] = ((double)m[3] * m[2] - (double)m[0] * m[5]) / det;
+		break;
+	}
+	affine_set(inverse, r);
+	return 0;
+}
+
+void
+affine_transform(const struct affine *a, double *x, double *y)
+{
+	const float *m = a->m;
+	double tx;
+
+	switch (a->type) {
+	case 0:
+		break;
+	case AFFINE_TRANSLATE:
+		*x += m[2];
+		*y += m[5];
+		break;
+	case AFFINE_SCALE:
+	case AFFINE_SCALE | AFFINE_TRANSLATE:
+		*x = m[0] * *x + m[2];
+		*y = m[4] * *y + m[5];
+		break;
+	case AFFINE_ROTATE:
+	case AFFINE_ROTATE | AFFINE_TRANSLATE:
+	case AFFINE_ROTATE | AFFINE_SCALE:
+	case AFFINE_ROTATE | AFFINE_SCALE | AFFINE_TRANSLATE:
+		tx = m[1] * *y + m[2];
+		*y = m[3] * *x + m[5];
+		*x = tx;
+		break;
+	default:
+		tx = m[0] * *x + m[1] * *y + m[2];
+		*y = m[3] * *x + m[4] * *y + m[5];
+		*x = tx;
+		break;
+	}
+}
+
+/*
+ * The 2D part of a 4x4 matrix for points (x, y, 1, 1), which takes the
+ * offset from d[8], d[9] as written by finish_calibration() as well as
+ * from d[12], d[13] as in weston's 2D transforms.
+ */
+void
+affine_from_matrix(struct affine *a, const struct weston_matrix *matrix)
+{
+	const float *d = matrix->d;
+	float m[6];
+
+	m[0] = d[0];
+	m[1] = d[4];
+	m[2] = d[8] + d[12];
+	m[3] = d[1];
+	m[4] = d[5];
+	m[5] = d[9] + d[13];
+	affine_set(a, m);
+}
+
+/* In the layout of the calibration matrices, offset in d[8] and d[9] */
+void
+affine_to_matrix(struct weston_matrix *matrix, const struct affine *a)
+{
+	memset(matrix, 0, sizeof(*matrix));
+	matrix->d[0] = a->m[0];
+	matrix->d[4] = a->m[1];
+	matrix->d[8] = a->m[2];
+	matrix->d[1] = a->m[3];
+	matrix->d[5] = a->m[4];
+	matrix->d[9] = a->m[5];
+	matrix->d[10] = 1;
+	matrix->d[15] = 1;
+	matrix->type = a->type;
+}
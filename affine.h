@@ -0,0 +1,57 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_AFFINE_H
+#define CALTOOL_AFFINE_H
+
+#include "matrix.h"
+
+/*
+ * Type flags, computed from the coefficients. ROTATE covers the axis swaps
+ * of 90 and 270 degree rotations only, anything else is OTHER. No flag at
+ * all is the identity.
+ */
+enum affine_type {
+	AFFINE_TRANSLATE	= WESTON_MATRIX_TRANSFORM_TRANSLATE,
+	AFFINE_SCALE		= WESTON_MATRIX_TRANSFORM_SCALE,
+	AFFINE_ROTATE		= WESTON_MATRIX_TRANSFORM_ROTATE,
+	AFFINE_OTHER		= WESTON_MATRIX_TRANSFORM_OTHER,
+};
+
+/*
+ * x' = m[0] x + m[1] y + m[2]
+ * y' = m[3] x + m[4] y + m[5]
+ *
+ * The order of LIBINPUT_CALIBRATION_MATRIX and libinput's float[6].
+ */
+struct affine {
+	float m[6];
+	unsigned int type;
+};
+
+void affine_init(struct affine *);
+void affine_set(struct affine *, const float *);
+void affine_multiply(struct affine *, const struct affine *);
+int affine_invert(struct affine *, const struct affine *);
+void affine_transform(const struct affine *, double *, double *);
+
+void affine_from_matrix(struct affine *, const struct weston_matrix *);
+void affine_to_matrix(struct weston_matrix *, const struct affine *);
+
+#endif /* CALTOOL_AFFINE_H */
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Unattended calibration session: tsinject taps the targets through a
+# virtual touch screen while caltool records session time and latency.
+# Before the first tap it floods caltool with motion reports, which
+# caltool discards but counts in its dispatch statistics.
+# Needs root for /dev/uinput and the framebuffer.
+
+STATS=${STATS:-bench_stats.txt}
+
+# known distortion, the resulting matrix should undo it
+DISTORTION=${DISTORTION:-1.02,0.01,-5,-0.01,0.98,4}
+
+# call caltool in the background, on the virtual panel only
+./caltool -c bench.cal -s $STATS -n tsinject &
+CALTOOL=$!
+
+# flood, then tap all targets
+./tsinject -w 2000 -i 300 -D $DISTORTION -n ${NOISE:-0.5} -b ${BURST:-100000}
+
+wait $CALTOOL
+
+# latency and event throughput of this session, as caltool saw it
+awk '/^# framebuffer=/ { s = "" } { s = s $0 "\n" } END { printf "%s", s }' $STATS
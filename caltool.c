@@ -33,6 +33,8 @@
 #include "fbutils.h"
 #include "touch.h"
 #include "matrix.h"
+#include "stats.h"
+#include "rt.h"
 #include "cmdline_parser.h"
 
 #include <libinput.h>
@@ -49,6 +51,41 @@ FILE* cal_file = NULL;
 
 int verbose = 1;
 const char *seat = "seat0";
+
+// touch-to-photon latency of the accepted samples
+struct latency_stats latency;
+char stats_file[255] = "";
+
+// calibrate all touch devices in one session
+int multi_device = 0;
+
+// only calibrate touch devices of this name, -n
+char device_name[128] = "";
+
+// draw a live marker at every contact
+int live_feedback = 0;
+
+// calibration targets, -p
+struct test_layout test_layout;
+
+// fit a non-linear correction grid on top of the matrix, -g
+int correction_grid = 0;
+
+// retake targets whose sample is farther off than this (px), 0 keeps all
+double outlier_px = 0;
+#define MAX_RETAKES 3
+
+// smoothing of the sample positions, CALTOOL_FILTER overrides it per device
+struct sample_filter_config sample_filter_default = { SAMPLE_FILTER_NONE, ONE_EURO_MIN_CUTOFF, ONE_EURO_BETA };
+
+// extrapolate live markers this far ahead (usec), 0 draws measured positions
+unsigned long predict_usec = 0;
+
+// SCHED_FIFO priority of the input path, 0 runs with normal priority
+int rt_priority = 0;
+
+// accept a target once the finger rests below this variance (px^2), 0 takes the touch down
+double dwell_variance = 0;
 static int palette [] =
 {
 	0x000000, 0xffe080, 0xffffff, 0xe0c0a0
@@ -59,12 +96,117 @@ struct udev *udev;
 extern int xres;
 extern int yres;
 
+/*
+ * Show one target until every calibrator in need has a sample for it.
+ * need NULL asks all of them. Returns -1 if interrupted.
+ */
+static int
+sample_target(struct libinput *li, struct calibration *cal, struct pollfd *fds,
+	      int test, const unsigned char *need)
+{
+	int32_t drawn_x, drawn_y;
+	struct calibrator *calibrator;
+	struct sample_times *times;
+	int i;
+	
+	// Calculate x,y coordinates for cross
+	drawn_x = test_layout.ratio[test].x_ratio * xres;
+	drawn_y = test_layout.ratio[test].y_ratio * yres;
+	
+	// save values for later calculations, every device taps the same cross
+	for (i = 0; i < cal->num_calibrators; i++) {
+		calibrator = &cal->calibrators[i];
+		calibrator->current_test = test;
+		calibrator->got_sample = need && !need[i];
+		calibrator->pending = 0;
+		if (calibrator->got_sample)
+			continue;
+		calibrator->tests[test].drawn_x = drawn_x;
+		calibrator->tests[test].drawn_y = drawn_y;
+		memset(&calibrator->tests[test].time, 0, sizeof(struct sample_times));
+	}
+	
+	// draw cross on actual position
+	put_cross(drawn_x, drawn_y, 2 | XORMODE);
+	
+	// reset wait for touch event
+	got_sample = all_sampled(cal);
+	
+	// wait until every device has been touched
+	while (!got_sample &&
+	       poll(fds, 2, feedback_timeout(&cal->feedback, monotonic_usec())) > -1) {
+		if (fds[1].revents)
+			break;
+			
+		cal->wakeups++;
+		handle_events(li, cal);
+		feedback_flush(&cal->feedback, monotonic_usec());
+	}
+	// clear cross on actual position
+	put_cross(drawn_x, drawn_y, 2 | XORMODE);
+	
+	if (!got_sample)
+		return -1;
+	
+	// feedback is visible with the next vsync
+	for (i = 0; i < cal->num_calibrators; i++) {
+		times = &cal->calibrators[i].tests[test].time;
+		times->drawn = monotonic_usec();
+		times->presented = times->drawn;
+	}
+	if (fb_wait_vsync() == 0) {
+		for (i = 0; i < cal->num_calibrators; i++)
+			cal->calibrators[i].tests[test].time.presented = monotonic_usec();
+	}
+	for (i = 0; i < cal->num_calibrators; i++) {
+		if (!need || need[i])
+			latency_stats_add(&latency, &cal->calibrators[i].tests[test].time);
+	}
+	return 0;
+}
+
+/*
+ * Show the targets whose samples do not fit the others again, up to
+ * MAX_RETAKES rounds. What is still off after that is left out of the fit.
+ */
+static void
+retake_outliers(struct libinput *li, struct calibration *cal, struct pollfd *fds)
+{
+	unsigned char need[MAX_TOUCH_DEVICES];
+	int round, test, i, outliers, any;
+	
+	for (round = 0; ; round++) {
+		outliers = 0;
+		for (i = 0; i < cal->num_calibrators; i++)
+			outliers += find_outliers(&cal->calibrators[i], outlier_px);
+		if (outliers == 0 || round == MAX_RETAKES)
+			break;
+		
+		for (test = 0; test < test_layout.num; test++) {
+			any = 0;
+			for (i = 0; i < cal->num_calibrators; i++) {
+				need[i] = cal->calibrators[i].tests[test].outlier;
+				any |= need[i];
+			}
+			if (!any)
+				continue;
+			
+			fprintf(fp_log, "Retaking target %d, round %d\n", test, round + 1);
+			if (sample_target(li, cal, fds, test, need) < 0)
+				return;
+		}
+	}
+	if (outliers)
+		fprintf(fp_log, "%d outliers left out after %d retakes\n", outliers, MAX_RETAKES);
+}
+
 void
-sample_cal_values(struct libinput *li, struct calibrator *calibrator)
+sample_cal_values(struct libinput *li, struct calibration *cal)
 {
 	struct pollfd fds[2];
 	sigset_t mask;
-	int32_t drawn_x, drawn_y;
+	int test;
+	int i;
 	
 	fds[0].fd = libinput_get_fd(li);
 	fds[0].events = POLLIN;
@@ -84,56 +226,113 @@ sample_cal_values(struct libinput *li, struct calibrator *calibrator)
 	}
 
 	/* Handle already-pending device added events */
-	if (handle_events(li, calibrator))
+	if (handle_events(li, cal))
 		fprintf(stderr, "Expected device added events on startup but got none. "
 				"Maybe you don't have the right permissions?\n");
 	
-	// reset test to 0
-	calibrator->current_test = 0;
+	if (cal->multi_device)
+		fprintf(fp_log, "Calibrating %d touch devices\n", cal->num_calibrators);
+	cal->started = 1;
 	
-	// got samples values defined in test_ratios
-	while(calibrator->current_test < ARRAY_LENGTH(test_ratios))
+	// got samples values defined in the test layout
+	for (test = 0; test < test_layout.num; test++)
 	{
-		// Calculate x,y coordinates for cross
-		drawn_x = test_ratios[calibrator->current_test].x_ratio * xres;
-		drawn_y = test_ratios[calibrator->current_test].y_ratio * yres;
-		
-		// save values for later calculations
-		calibrator->tests[calibrator->current_test].drawn_x = drawn_x;
-		calibrator->tests[calibrator->current_test].drawn_y = drawn_y;
-		
-		// draw cross on actual position
-		put_cross(drawn_x, drawn_y, 2 | XORMODE);
+		if (sample_target(li, cal, fds, test, NULL) < 0)
+			break;
 		
-		// reset wait for touch event
-		got_sample = 0;
-		
-		// wait for touch event
-		while (poll(fds, 2, -1) > -1) {
-			if (fds[1].revents)
-				break;
-			if (got_sample > 0)
-				break;
-				
-			handle_events(li, calibrator);
-		
-		}
-		// clear cross on actual position
-		put_cross(drawn_x, drawn_y, 2 | XORMODE);
-		
-		// next test set
-		calibrator->current_test++;
+		for (i = 0; i < cal->num_calibrators; i++)
+			cal->calibrators[i].num_tests = test + 1;
 	}
 	
+	if (outlier_px > 0 && test == test_layout.num)
+		retake_outliers(li, cal, fds);
+	
+	feedback_clear(&cal->feedback);
 	close(fds[1].fd);
 }
 
+void
+write_latency_stats(struct calibration *cal, uint64_t session_usec)
+{
+	FILE *fp_stats;
+	int i;
+	
+	fprintf(fp_log, "Session time: %llu usec\n", (unsigned long long)session_usec);
+	fprintf(fp_log, "Touch latency (framebuffer %.16s):\n", fb_id());
+	latency_stats_print(fp_log, &latency);
+	
+	if (*stats_file == '\0')
+		return;
+	
+	// append, so several sessions on one board can be compared
+	fp_stats = fopen(stats_file, "a");
+	if (fp_stats == NULL) {
+		fprintf(fp_log, "Error opening stats file %s !!\n", stats_file);
+		return;
+	}
+	fprintf(fp_stats, "# framebuffer=%.16s xres=%d yres=%d session=%llu usec\n",
+		fb_id(), xres, yres, (unsigned long long)session_usec);
+	for (i = 0; i < cal->num_calibrators; i++)
+		fprintf(fp_stats, "# touch=%s (%s)\n", cal->calibrators[i].name, cal->calibrators[i].sysname);
+	latency_stats_print(fp_stats, &latency);
+	print_input_health(fp_stats, cal);
+	fclose(fp_stats);
+}
+
+/*
+ * A value for a udev match, quotes and glob characters in it are matched
+ * by '?', which udev rules cannot escape otherwise.
+ */
+static void
+print_udev_value(FILE *fp, const char *value)
+{
+	for (; *value; value++)
+		fputc(strchr("\"\\*[", *value) ? '?' : *value, fp);
+}
+
+/*
+ * Write a udev rule for a single touch device, used when several devices
+ * are calibrated in one session and the template only matches one. The
+ * udev ID_PATH tells identical controllers apart, the name is a fallback
+ * for devices without one.
+ */
+void
+write_device_rule(const char *rule_file, const struct calibrator *calibrator,
+		  struct weston_matrix *cal_matrix)
+{
+	FILE *fp_udev;
+	
+	fp_udev = fopen(rule_file, "w");
+	if (fp_udev == NULL) {
+		fprintf(fp_log, "Error opening udev output file %s !!\n", rule_file);
+		return;
+	}
+	
+	fprintf(fp_udev, "SUBSYSTEM==\"input\", KERNEL==\"event[0-9]*\", ");
+	if (*calibrator->id_path) {
+		fprintf(fp_udev, "ENV{ID_PATH}==\"");
+		print_udev_value(fp_udev, calibrator->id_path);
+	} else {
+		fprintf(fp_log, "%s: no ID_PATH, rule matches by name only\n", calibrator->sysname);
+		fprintf(fp_udev, "ATTRS{name}==\"");
+		print_udev_value(fp_udev, calibrator->name);
+	}
+	fprintf(fp_udev, "\"");
+	fprintf(fp_udev,", ENV{LIBINPUT_CALIBRATION_MATRIX}=");
+	fprintf(fp_udev,"\"%f %f %f %f %f %f\"\n",
+		cal_matrix->d[0], cal_matrix->d[4], cal_matrix->d[8],
+		cal_matrix->d[1], cal_matrix->d[5], cal_matrix->d[9]);
+	fclose(fp_udev);
+}
+
 int main(int argc, char **argv)
 {
 	// libinput
 	struct libinput *li;
-	struct calibrator calibrator;
-	struct weston_matrix cal_matrix;
+	struct calibration calibration;
+	struct calibrator *calibrator;
+	struct weston_matrix cal_matrix, model_matrix;
+	struct correction_grid grid;
 	
 	// general use
 	unsigned int i;
@@ -141,6 +340,9 @@ int main(int argc, char **argv)
 	int nread;
 	int rotation=0;
 	int use_calfile=0;
+	uint64_t session_start;
+	char device_file[300];
+	char side_file[310];
 	
 	FILE* fp_template = NULL;
 	FILE* fp_udev = NULL;
@@ -163,6 +365,7 @@ int main(int argc, char **argv)
 	}
 
 	// get commandline options
+	layout_parse(&test_layout, LAYOUT_DEFAULT);
 	cmdline_parser(argc, argv, &rotation, &use_calfile, cal_file);
 	
 	fprintf(fp_log,"Using cal file: %s\n", cal_file);
@@ -233,8 +436,17 @@ int main(int argc, char **argv)
 		for (i = 0; i < NR_COLORS; i++)
 			setcolor (i, palette [i]);
 		
+		// real-time mode, framebuffer pages are locked with everything else
+		if (rt_priority > 0) {
+			rt_enable(fp_log, rt_priority);
+			fb_prefault();
+			rt_measure_latency(fp_log);
+		}
+		
 		//log screen size 
 		fprintf(fp_log,"detected Resolution: x=%d y=%d\n", xres, yres);
+		fprintf(fp_log,"framebuffer map: %llu usec, clear: %llu usec\n",
+			(unsigned long long)fb_map_usec, (unsigned long long)fb_clear_usec);
 		
 		
 		//log parameter
@@ -244,21 +456,83 @@ int main(int argc, char **argv)
 		put_string_center (xres / 2, yres / 4, "Touch Calibration Tool", 1);
 		put_string_center (xres / 2, yres / 4 + 20, "Touch crosshair to calibrate", 2);
 		
+		init_calibration(&calibration, multi_device);
+		feedback_init(&calibration.feedback, live_feedback, fb_refresh_rate());
+		feedback_set_prediction(&calibration.feedback, predict_usec);
+		
 		//open libinput device
-		if (open_udev(&li))
+		if (open_udev(&li, &calibration))
 				return 1;
 		
 		// sample values for calibration
-		sample_cal_values(li, &calibrator);
-				
-		// calculate calibration values
-		finish_calibration(&calibrator, &cal_matrix);
+		latency_stats_init(&latency);
+		session_start = monotonic_usec();
+		sample_cal_values(li, &calibration);
+		write_latency_stats(&calibration, monotonic_usec() - session_start);
+		print_touch_counters(fp_log, &calibration);
+		print_input_health(fp_log, &calibration);
+		feedback_print(fp_log, &calibration.feedback);
+		fprintf(fp_log, "Wakeups: %lu, ignored non-touch events: %lu, touch events of other devices: %lu\n",
+			calibration.wakeups, calibration.ignored_events, calibration.foreign_events);
+		
+		if (calibration.num_calibrators == 0)
+			fprintf(fp_log, "No touch device found !!\n");
 		
-		// write calibration values to file
-		fp_cal = fopen(cal_file,"w");
-		fwrite(&cal_matrix, sizeof(struct weston_matrix), 1, fp_cal);
-		//fprintf(fd,"%f %f %f %f %f %f\n", x_calib.f[0], x_calib.f[1], (x_calib.f[2]/xres), y_calib.f[0], y_calib.f[1], (y_calib.f[2]/yres));
-		fclose(fp_cal);
+		for (i = 0; i < (unsigned int)calibration.num_calibrators; i++) {
+			calibrator = &calibration.calibrators[i];
+			
+			// calculate calibration values
+			if (finish_calibration(calibrator, &cal_matrix) < 0) {
+				fprintf(fp_log, "No calibration for %s !!\n", calibrator->sysname);
+				continue;
+			}
+			
+			// write calibration values to file, one per device in multi device mode
+			if (calibration.multi_device)
+				snprintf(device_file, sizeof(device_file), "%s.%s", cal_file, calibrator->sysname);
+			else
+				snprintf(device_file, sizeof(device_file), "%s", cal_file);
+			
+			fp_cal = fopen(device_file,"w");
+			if (fp_cal == NULL) {
+				fprintf(fp_log, "Error opening cal file %s !!\n", device_file);
+				continue;
+			}
+			fwrite(&cal_matrix, sizeof(struct weston_matrix), 1, fp_cal);
+			//fprintf(fd,"%f %f %f %f %f %f\n", x_calib.f[0], x_calib.f[1], (x_calib.f[2]/xres), y_calib.f[0], y_calib.f[1], (y_calib.f[2]/yres));
+			fclose(fp_cal);
+			
+			// libinput only takes the affine matrix, a projective model goes next to it
+			model_matrix = cal_matrix;
+			if (finish_projective(calibrator, &model_matrix) > 0) {
+				snprintf(side_file, sizeof(side_file), "%s.proj", device_file);
+				fp_cal = fopen(side_file, "w");
+				if (fp_cal == NULL) {
+					fprintf(fp_log, "Error opening projective file %s !!\n", side_file);
+				} else {
+					fwrite(&model_matrix, sizeof(struct weston_matrix), 1, fp_cal);
+					fclose(fp_cal);
+				}
+			}
+			
+			// as does the residual non-linearity of that model
+			if (correction_grid && finish_correction(calibrator, &model_matrix, &grid) == 0) {
+				snprintf(side_file, sizeof(side_file), "%s.grid", device_file);
+				if (correction_save(&grid, side_file) < 0)
+					fprintf(fp_log, "Error writing correction grid %s !!\n", side_file);
+			}
+			
+			/*
+			* The rules are for the screen as calibrated: unrotated, -r only
+			* rotates the single cal file, and every device is assumed to
+			* cover fb0, whose resolution the targets were drawn in.
+			*/
+			if (calibration.multi_device) {
+				snprintf(device_file, sizeof(device_file), "touchscreen-%s.rules", calibrator->sysname);
+				write_device_rule(device_file, calibrator, &cal_matrix);
+			}
+		}
+		release_calibration(&calibration);
 					
 		// close udev
 		libinput_unref(li);
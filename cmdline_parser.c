@@ -18,26 +18,53 @@
 */
 
 #include "version.h"
+#include "filter.h"
+#include "layout.h"
+#include "solver.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 
+extern char stats_file[255];
+extern int multi_device;
+extern char device_name[128];
+extern double dwell_variance;
+extern int rt_priority;
+extern int live_feedback;
+extern unsigned long predict_usec;
+extern struct sample_filter_config sample_filter_default;
+extern struct test_layout test_layout;
+extern double outlier_px;
+extern int correction_grid;
 
 void cmdline_parser(int argc, char **argv, int *rotation, int *use_calfile, char *cal_file){
 
 	// locale variables
 	int c;
 	int rot;
+	int i;
+	double x[MAX_TESTS], y[MAX_TESTS];
 	
 	const char* Usage = "\n"\
     "  -v              			print version information\n"\
 	"  -c [calibration file]	specify file for calibration\n" \
 	"  -r [rotation]   			sets rotation of touch calibration default=landscape \n"\
+	"  -s [stats file]			append touch latency statistics to file\n"\
+	"  -m              			calibrate all touch devices on fb0, one cal and rules file each (unrotated)\n"\
+	"  -n [name]       			only calibrate touch devices of this name\n"\
+	"  -d [variance]   			accept a target once the finger rests below variance (px^2)\n"\
+	"  -R [priority]   			real-time mode, SCHED_FIFO priority and locked memory\n"\
+	"  -l              			show a live marker at every contact\n"\
+	"  -P [ms]         			predict live markers this far ahead (with -l)\n"\
+	"  -f [filter]     			smooth samples: none, median, oneeuro[:mincutoff[,beta]]\n"\
+	"  -p [layout]     			targets: 3, 5, 9, 25 or x,y;x,y;... screen ratios\n"\
+	"  -o [px]         			retake targets this far off a robust fit (-p 9 or 25)\n"\
+	"  -g              			also write a non-linear correction grid (9 or more targets)\n"\
 	"\n";
 	
 	// check commandline arguments
-	while ((c = getopt (argc, argv, "vr:c:")) != -1)
+	while ((c = getopt (argc, argv, "vmlgr:c:s:d:n:R:P:f:p:o:")) != -1)
 	{
 		switch (c) {
 			case 'v':
@@ -61,6 +88,114 @@ void cmdline_parser(int argc, char **argv, int *rotation, int *use_calfile, char
 					exit(EXIT_FAILURE);
 				}
 			break;
+			// multi device calibration
+			case 'm':
+				multi_device = 1;
+			break;
+			// device selection
+			case 'n':
+				if (optarg != NULL)
+				{
+					snprintf(device_name, sizeof(device_name), "%s", optarg);
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// dwell capture
+			case 'd':
+				if (optarg != NULL)
+				{
+					dwell_variance = atof(optarg);
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// live touch markers
+			case 'l':
+				live_feedback = 1;
+			break;
+			// sample smoothing
+			case 'f':
+				if (optarg == NULL || sample_filter_parse(&sample_filter_default, optarg) < 0)
+				{
+					printf("Error: Invalid filter !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// target layout
+			case 'p':
+				if (optarg == NULL || layout_parse(&test_layout, optarg) < 0)
+				{
+					printf("Error: Invalid layout !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// non-linear correction
+			case 'g':
+				correction_grid = 1;
+			break;
+			// outlier retakes
+			case 'o':
+				if (optarg != NULL)
+				{
+					outlier_px = atof(optarg);
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// live marker prediction
+			case 'P':
+				if (optarg != NULL)
+				{
+					predict_usec = atof(optarg) * 1000;
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// real-time mode
+			case 'R':
+				if (optarg != NULL)
+				{
+					rt_priority = atoi(optarg);
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
+			// latency statistics file
+			case 's':
+				if (optarg != NULL)
+				{
+					snprintf(stats_file, sizeof(stats_file), "%s", optarg);
+				}
+				else
+				{
+					printf("Error: Argument needed !!\n");
+					printf("Exiting ...\n");
+					exit(EXIT_FAILURE);
+				}
+			break;
 			// screen rotation
 			case 'r':
 				if (optarg != NULL)
@@ -98,5 +233,18 @@ void cmdline_parser(int argc, char **argv, int *rotation, int *use_calfile, char
 				break;
 		}
 	}
+	
+	// -o and -p come in any order, so the layout is checked once both are known
+	if (outlier_px > 0) {
+		for (i = 0; i < test_layout.num; i++) {
+			x[i] = test_layout.ratio[i].x_ratio;
+			y[i] = test_layout.ratio[i].y_ratio;
+		}
+		if (!robust_identifiable(x, y, test_layout.num)) {
+			printf("Error: -o needs a layout that can single out a bad target, e.g. -p 9 !!\n");
+			printf("Exiting ...\n");
+			exit(EXIT_FAILURE);
+		}
+	}
 }
 	
\ No newline at end of file
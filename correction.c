@@ -0,0 +1,244 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "correction.h"
+
+/*
+ * Monomials x^i y^j with i + j <= degree of the point mapped to [-1, 1],
+ * which keeps the normal equations well conditioned.
+ */
+static int
+monomials(int degree, double x, double y, double *m)
+{
+	double u = 2 * x - 1, v = 2 * y - 1;
+	double pu[4], pv[4];
+	int i, j, n = 0;
+
+	pu[0] = pv[0] = 1;
+	for (i = 1; i <= degree; i++) {
+		pu[i] = pu[i - 1] * u;
+		pv[i] = pv[i - 1] * v;
+	}
+	for (i = 0; i <= degree; i++) {
+		for (j = 0; j + i <= degree; j++)
+			m[n++] = pu[i] * pv[j];
+	}
+	return n;
+}
+
+/* Gaussian elimination with partial pivoting, a is n x n row major */
+static int
+solve_linear(double *a, double *b, double *c, int n)
+{
+	double f, t;
+	int i, j, k, p;
+
+	for (k = 0; k < n; k++) {
+		p = k;
+		for (i = k + 1; i < n; i++) {
+			if (fabs(a[i * n + k]) > fabs(a[p * n + k]))
+				p = i;
+		}
+		if (fabs(a[p * n + k]) < 1e-12)
+			return -1;
+		if (p != k) {
+			for (j = 0; j < n; j++) {
+				t = a[k * n + j];
+				a[k * n + j] = a[p * n + j];
+				a[p * n + j] = t;
+			}
+			t = b[k];
+			b[k] = b[p];
+			b[p] = t;
+			t = c[k];
+			c[k] = c[p];
+			c[p] = t;
+		}
+		for (i = k + 1; i < n; i++) {
+			f = a[i * n + k] / a[k * n + k];
+			for (j = k; j < n; j++)
+				a[i * n + j] -= f * a[k * n + j];
+			b[i] -= f * b[k];
+			c[i] -= f * c[k];
+		}
+	}
+	for (k = n - 1; k >= 0; k--) {
+		for (j = k + 1; j < n; j++) {
+			b[k] -= a[k * n + j] * b[j];
+			c[k] -= a[k * n + j] * c[j];
+		}
+		b[k] /= a[k * n + k];
+		c[k] /= a[k * n + k];
+	}
+	return 0;
+}
+
+/*
+ * Least squares polynomial for the errors (ex, ey) at n points (x, y),
+ * cubic from 16 points on, quadratic from 9. Returns -1 with fewer points
+ * or if they do not determine the polynomial.
+ */
+int
+correction_fit(struct correction_poly *poly, const double *x, const double *y,
+	       const double *ex, const double *ey, int n)
+{
+	double ata[CORRECTION_MAX_TERMS * CORRECTION_MAX_TERMS];
+	double m[CORRECTION_MAX_TERMS];
+	int i, j, k, terms;
+
+	if (n >= 16)
+		poly->degree = 3;
+	else if (n >= 9)
+		poly->degree = 2;
+	else
+		return -1;
+	terms = (poly->degree + 1) * (poly->degree + 2) / 2;
+	poly->terms = terms;
+
+	memset(ata, 0, sizeof(ata));
+	memset(poly->cx, 0, sizeof(poly->cx));
+	memset(poly->cy, 0, sizeof(poly->cy));
+	for (k = 0; k < n; k++) {
+		monomials(poly->degree, x[k], y[k], m);
+		for (i = 0; i < terms; i++) {
+			for (j = 0; j < terms; j++)
+				ata[i * terms + j] += m[i] * m[j];
+			poly->cx[i] += m[i] * ex[k];
+			poly->cy[i] += m[i] * ey[k];
+		}
+	}
+	return solve_linear(ata, poly->cx, poly->cy, terms);
+}
+
+void
+correction_poly_eval(const struct correction_poly *poly, double x, double y,
+		     double *dx, double *dy)
+{
+	double m[CORRECTION_MAX_TERMS];
+	int i;
+
+	monomials(poly->degree, x, y, m);
+	*dx = 0;
+	*dy = 0;
+	for (i = 0; i < poly->terms; i++) {
+		*dx += poly->cx[i] * m[i];
+		*dy += poly->cy[i] * m[i];
+	}
+}
+
+void
+correction_bake(struct correction_grid *grid, const struct correction_poly *poly)
+{
+	const int size = CORRECTION_GRID_SIZE;
+	double dx, dy;
+	int row, col;
+
+	grid->size = size;
+	for (row = 0; row < size; row++) {
+		for (col = 0; col < size; col++) {
+			correction_poly_eval(poly, (double)col / (size - 1),
+					     (double)row / (size - 1), &dx, &dy);
+			grid->dx[row * size + col] = dx;
+			grid->dy[row * size + col] = dy;
+		}
+	}
+}
+
+/*
+ * Add the bilinearly interpolated offset at (x, y), in normalized screen
+ * coordinates after the affine calibration. Outside the screen the edge
+ * cells are extended.
+ */
+void
+correction_apply(const struct correction_grid *grid, double *x, double *y)
+{
+	const int size = grid->size;
+	double gx, gy, fx, fy, top, bottom;
+	int col, row, i;
+
+	gx = *x * (size - 1);
+	gy = *y * (size - 1);
+	col = gx < 0 ? 0 : gx >= size - 1 ? size - 2 : (int)gx;
+	row = gy < 0 ? 0 : gy >= size - 1 ? size - 2 : (int)gy;
+	fx = gx - col;
+	fy = gy - row;
+	i = row * size + col;
+
+	top = grid->dx[i] + fx * (grid->dx[i + 1] - grid->dx[i]);
+	bottom = grid->dx[i + size] + fx * (grid->dx[i + size + 1] - grid->dx[i + size]);
+	*x += top + fy * (bottom - top);
+
+	top = grid->dy[i] + fx * (grid->dy[i + 1] - grid->dy[i]);
+	bottom = grid->dy[i + size] + fx * (grid->dy[i + size + 1] - grid->dy[i + size]);
+	*y += top + fy * (bottom - top);
+}
+
+/*
+ * File layout, host byte order: the 8 magic bytes, the node count per
+ * axis and the base model as uint32, then all dx and all dy as float,
+ * row major.
+ */
+int
+correction_save(const struct correction_grid *grid, const char *path)
+{
+	const size_t nodes = (size_t)grid->size * grid->size;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return -1;
+	if (fwrite(CORRECTION_MAGIC, 8, 1, fp) != 1 ||
+	    fwrite(&grid->size, sizeof(grid->size), 1, fp) != 1 ||
+	    fwrite(&grid->base, sizeof(grid->base), 1, fp) != 1 ||
+	    fwrite(grid->dx, sizeof(float), nodes, fp) != nodes ||
+	    fwrite(grid->dy, sizeof(float), nodes, fp) != nodes)
+		ret = -1;
+	if (fclose(fp) != 0)
+		ret = -1;
+	return ret;
+}
+
+int
+correction_load(struct correction_grid *grid, const char *path)
+{
+	char magic[8];
+	size_t nodes;
+	FILE *fp;
+	int ret = -1;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+	if (fread(magic, 8, 1, fp) == 1 && memcmp(magic, CORRECTION_MAGIC, 8) == 0 &&
+	    fread(&grid->size, sizeof(grid->size), 1, fp) == 1 &&
+	    fread(&grid->base, sizeof(grid->base), 1, fp) == 1 &&
+	    grid->size == CORRECTION_GRID_SIZE && grid->base <= CORRECTION_PROJECTIVE) {
+		nodes = (size_t)grid->size * grid->size;
+		if (fread(grid->dx, sizeof(float), nodes, fp) == nodes &&
+		    fread(grid->dy, sizeof(float), nodes, fp) == nodes)
+			ret = 0;
+	}
+	fclose(fp);
+	return ret;
+}
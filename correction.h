@@ -0,0 +1,64 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_CORRECTION_H
+#define CALTOOL_CORRECTION_H
+
+#include <stdint.h>
+
+/*
+ * Non-linear correction on top of the calibration: a bivariate
+ * polynomial fitted to what the affine or projective fit leaves at the
+ * targets, baked into a grid of offsets over the screen, normalized to
+ * [0, 1].
+ */
+#define CORRECTION_MAX_TERMS	10	/* cubic */
+#define CORRECTION_GRID_SIZE	17	/* nodes per axis, 16 cells */
+#define CORRECTION_MAGIC	"CALGRID2"
+
+/* The model the offsets apply after, the cal file or its .proj sidecar */
+enum correction_base {
+	CORRECTION_AFFINE = 0,
+	CORRECTION_PROJECTIVE = 1,
+};
+
+struct correction_poly {
+	int degree;
+	int terms;
+	double cx[CORRECTION_MAX_TERMS];
+	double cy[CORRECTION_MAX_TERMS];
+};
+
+/* Offsets at the nodes, row major from the top left screen corner */
+struct correction_grid {
+	uint32_t size;
+	uint32_t base;		/* enum correction_base */
+	float dx[CORRECTION_GRID_SIZE * CORRECTION_GRID_SIZE];
+	float dy[CORRECTION_GRID_SIZE * CORRECTION_GRID_SIZE];
+};
+
+int correction_fit(struct correction_poly *, const double *, const double *,
+		   const double *, const double *, int);
+void correction_poly_eval(const struct correction_poly *, double, double, double *, double *);
+void correction_bake(struct correction_grid *, const struct correction_poly *);
+void correction_apply(const struct correction_grid *, double *, double *);
+int correction_save(const struct correction_grid *, const char *);
+int correction_load(struct correction_grid *, const char *);
+
+#endif /* CALTOOL_CORRECTION_H */
@@ -27,6 +27,7 @@
 
 #include "font.h"
 #include "fbutils.h"
+#include "stats.h"
 
 union multiptr {
 	unsigned char *p8;
@@ -38,11 +39,14 @@ static int con_fd, fb_fd, last_vt = -1;
 static struct fb_fix_screeninfo fix;
 static struct fb_var_screeninfo var;
 static unsigned char *fbuffer;
+static unsigned char *fbmap;
+static size_t fbmap_len;
 static unsigned char **line_addr;
 static int fb_fd=0;
 static int bytes_per_pixel;
 static unsigned colormap [256];
 int xres, yres;
+uint64_t fb_map_usec, fb_clear_usec;
 
 static char *defaultfbdevice = "/dev/fb0";
 static char *defaultconsoledevice = "/dev/tty";
@@ -55,6 +59,8 @@ int open_framebuffer(void)
 	char vtname[128];
 	int fd, nr;
 	unsigned y, addr;
+	size_t start, visible, page;
+	uint64_t t;
 
 	if ((fbdevice = getenv ("TSLIB_FBDEVICE")) == NULL)
 		fbdevice = defaultfbdevice;
@@ -129,18 +135,40 @@ int open_framebuffer(void)
 	xres = var.xres;
 	yres = var.yres;
 
-	fbuffer = mmap(NULL, fix.smem_len, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED, fb_fd, 0);
-	if (fbuffer == (unsigned char *)-1) {
+	/*
+	 * Only the visible lines are drawn to, so only they are mapped, even
+	 * if the virtual area is much larger. MAP_POPULATE sets up the page
+	 * tables now, so the first frame does not wait in the fault handler.
+	 */
+	page = sysconf(_SC_PAGESIZE);
+	visible = (size_t)var.yoffset * fix.line_length;
+	fbmap_len = (size_t)yres * fix.line_length;
+	if (visible + fbmap_len > fix.smem_len) {
+		visible = 0;
+		fbmap_len = fix.smem_len;
+	}
+	start = visible - visible % page;
+	fbmap_len += visible - start;
+
+	t = monotonic_usec();
+	fbmap = mmap(NULL, fbmap_len, PROT_READ | PROT_WRITE,
+		     MAP_FILE | MAP_SHARED | MAP_POPULATE, fb_fd, start);
+	if (fbmap == (unsigned char *)-1) {
 		perror("mmap framebuffer");
 		close(fb_fd);
 		return -1;
 	}
-	memset(fbuffer,0,fix.smem_len);
+	fb_map_usec = monotonic_usec() - t;
+	fbuffer = fbmap + (visible - start);
+
+	t = monotonic_usec();
+	memset(fbmap,0,fbmap_len);
+	fb_clear_usec = monotonic_usec() - t;
 
 	bytes_per_pixel = (var.bits_per_pixel + 7) / 8;
-	line_addr = malloc (sizeof (__u32) * var.yres_virtual);
+	line_addr = malloc (sizeof (*line_addr) * yres);
 	addr = 0;
-	for (y = 0; y < var.yres_virtual; y++, addr += fix.line_length)
+	for (y = 0; y < yres; y++, addr += fix.line_length)
 		line_addr [y] = fbuffer + addr;
 
 	return 0;
@@ -148,7 +176,7 @@ int open_framebuffer(void)
 
 void close_framebuffer(void)
 {
-	munmap(fbuffer, fix.smem_len);
+	munmap(fbmap, fbmap_len);
 	close(fb_fd);
 
 
@@ -167,6 +195,56 @@ void close_framebuffer(void)
         free (line_addr);
 }
 
+/*
+ * Block until the next vertical blank, i.e. until what was drawn so far
+ * has been scanned out. Returns -1 if the driver does not support it.
+ */
+int fb_wait_vsync(void)
+{
+	__u32 crtc = 0;
+
+	if (ioctl(fb_fd, FBIO_WAITFORVSYNC, &crtc) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Fault in every page of the mapping now instead of on the first drawing.
+ * Each page is read and written back unchanged.
+ */
+void fb_prefault(void)
+{
+	volatile unsigned char *p;
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned long offset;
+
+	for (offset = 0; offset < fbmap_len; offset += page) {
+		p = fbmap + offset;
+		*p = *p;
+	}
+}
+
+/* Refresh rate from the mode timings, 0 if the driver does not tell */
+double fb_refresh_rate(void)
+{
+	double htotal, vtotal;
+
+	if (var.pixclock == 0)
+		return 0;
+
+	htotal = var.xres + var.left_margin + var.right_margin + var.hsync_len;
+	vtotal = var.yres + var.upper_margin + var.lower_margin + var.vsync_len;
+
+	// pixclock is in picoseconds
+	return 1e12 / (var.pixclock * htotal * vtotal);
+}
+
+const char *fb_id(void)
+{
+	return fix.id;
+}
+
 void put_cross(int x, int y, unsigned colidx)
 {
 	line (x - 10, y, x - 2, y, colidx);
@@ -303,7 +381,7 @@ void pixel (int x, int y, unsigned colidx)
 	union multiptr loc;
 
 	if ((x < 0) || ((__u32)x >= var.xres_virtual) ||
-	    (y < 0) || ((__u32)y >= var.yres_virtual))
+	    (y < 0) || (y >= yres))
 		return;
 
 	xormode = colidx & XORMODE;
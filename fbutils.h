@@ -14,6 +14,7 @@
 #define _FBUTILS_H
 
 #include <asm/types.h>
+#include <stdint.h>
 
 /* This constant, being ORed with the color index tells the library
  * to draw in exclusive-or mode (that is, drawing the same second time
@@ -23,8 +24,15 @@
 
 extern int xres, yres;
 
+/* Time spent mapping (with MAP_POPULATE) and clearing the framebuffer */
+extern uint64_t fb_map_usec, fb_clear_usec;
+
 int open_framebuffer(void);
 void close_framebuffer(void);
+int fb_wait_vsync(void);
+void fb_prefault(void);
+double fb_refresh_rate(void);
+const char *fb_id(void);
 void setcolor(unsigned colidx, unsigned value);
 void put_cross(int x, int y, unsigned colidx);
 void put_string(int x, int y, char *s, unsigned colidx);
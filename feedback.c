@@ -0,0 +1,198 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "feedback.h"
+#include "fbutils.h"
+
+static void
+draw_marker(int x, int y)
+{
+	rect(x - FEEDBACK_MARKER, y - FEEDBACK_MARKER,
+	     x + FEEDBACK_MARKER, y + FEEDBACK_MARKER, 3 | XORMODE);
+}
+
+/* Markers are XORed, drawing again at the same place removes them */
+static void
+hide_slot(struct feedback_slot *s)
+{
+	if (s->shown)
+		draw_marker(s->shown_x, s->shown_y);
+	s->shown = 0;
+}
+
+static void
+show_slot(struct feedback_slot *s)
+{
+	hide_slot(s);
+	s->shown_x = s->x + 0.5;
+	s->shown_y = s->y + 0.5;
+	draw_marker(s->shown_x, s->shown_y);
+	s->shown = 1;
+	s->dirty = 0;
+}
+
+void
+feedback_init(struct feedback *fb, int enabled, double refresh_hz)
+{
+	memset(fb, 0, sizeof(*fb));
+	fb->enabled = enabled;
+	fb->frame_usec = refresh_hz > 0 ? 1000000 / refresh_hz : 16667;
+}
+
+/*
+ * Markers of moving contacts are drawn where the finger is expected to be
+ * when the frame is presented, from a constant velocity predictor fed with
+ * the event times. Touch down positions are drawn as measured.
+ */
+void
+feedback_set_prediction(struct feedback *fb, uint64_t predict_usec)
+{
+	fb->predict_usec = predict_usec;
+}
+
+void
+feedback_down(struct feedback *fb, int slot, double x, double y, uint64_t time)
+{
+	struct feedback_slot *s;
+
+	if (!fb->enabled || slot < 0 || slot >= FEEDBACK_SLOTS)
+		return;
+
+	// edges are never coalesced
+	s = &fb->slot[slot];
+	s->down = 1;
+	s->x = x;
+	s->y = y;
+	predictor_reset(&s->predictor, x, y, time);
+	show_slot(s);
+}
+
+void
+feedback_motion(struct feedback *fb, int slot, double x, double y, uint64_t time)
+{
+	struct feedback_slot *s;
+
+	if (!fb->enabled || slot < 0 || slot >= FEEDBACK_SLOTS)
+		return;
+
+	s = &fb->slot[slot];
+	if (!s->down)
+		return;
+
+	fb->motion_events++;
+	if (s->dirty)
+		fb->coalesced++;
+	s->x = x;
+	s->y = y;
+	s->dirty = 1;
+	if (fb->predict_usec)
+		predictor_update(&s->predictor, x, y, time);
+}
+
+void
+feedback_up(struct feedback *fb, int slot)
+{
+	struct feedback_slot *s;
+
+	if (!fb->enabled || slot < 0 || slot >= FEEDBACK_SLOTS)
+		return;
+
+	s = &fb->slot[slot];
+	if (s->dirty)
+		fb->coalesced++;
+	s->down = 0;
+	s->dirty = 0;
+	hide_slot(s);
+}
+
+/* Draw the latest position of every moved slot, once per frame interval */
+void
+feedback_flush(struct feedback *fb, uint64_t now)
+{
+	int i, drawn = 0;
+
+	if (!fb->enabled || now - fb->last_frame < fb->frame_usec)
+		return;
+
+	for (i = 0; i < FEEDBACK_SLOTS; i++) {
+		if (!fb->slot[i].dirty)
+			continue;
+		if (fb->predict_usec)
+			predictor_predict(&fb->slot[i].predictor, now + fb->predict_usec,
+					  &fb->slot[i].x, &fb->slot[i].y);
+		show_slot(&fb->slot[i]);
+		drawn = 1;
+	}
+
+	if (drawn) {
+		fb->last_frame = now;
+		fb->frames++;
+	}
+}
+
+/* poll() timeout until the next frame is due, -1 if nothing is pending */
+int
+feedback_timeout(struct feedback *fb, uint64_t now)
+{
+	uint64_t due;
+	int i;
+
+	if (!fb->enabled)
+		return -1;
+
+	for (i = 0; i < FEEDBACK_SLOTS; i++) {
+		if (fb->slot[i].dirty)
+			break;
+	}
+	if (i == FEEDBACK_SLOTS)
+		return -1;
+
+	due = fb->last_frame + fb->frame_usec;
+	if (due <= now)
+		return 0;
+	return (due - now + 999) / 1000;
+}
+
+void
+feedback_clear(struct feedback *fb)
+{
+	int i;
+
+	for (i = 0; i < FEEDBACK_SLOTS; i++) {
+		hide_slot(&fb->slot[i]);
+		fb->slot[i].down = 0;
+		fb->slot[i].dirty = 0;
+	}
+}
+
+void
+feedback_print(FILE *fp, struct feedback *fb)
+{
+	if (!fb->enabled)
+		return;
+
+	fprintf(fp, "Live feedback: %lu motion events, %lu coalesced, %lu frames (%llu usec)\n",
+		fb->motion_events, fb->coalesced, fb->frames,
+		(unsigned long long)fb->frame_usec);
+	if (fb->predict_usec)
+		fprintf(fp, "Live feedback: markers predicted %llu usec ahead\n",
+			(unsigned long long)fb->predict_usec);
+}
@@ -0,0 +1,67 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_FEEDBACK_H
+#define CALTOOL_FEEDBACK_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "filter.h"
+
+/* Seat slots with a live marker */
+#define FEEDBACK_SLOTS	16
+
+/* Half size of the live touch marker in pixels */
+#define FEEDBACK_MARKER	4
+
+/*
+ * Live touch markers. Touch down and up are drawn at once, motion only
+ * updates the latest position of its slot, which is drawn at most once
+ * per display frame.
+ */
+struct feedback {
+	int enabled;
+	uint64_t frame_usec;		/* display refresh interval */
+	uint64_t last_frame;
+	uint64_t predict_usec;		/* draw this far ahead of the flush, 0 off */
+	struct feedback_slot {
+		int down;
+		int dirty;		/* position newer than the marker */
+		int shown;		/* marker on screen */
+		double x, y;		/* latest position */
+		int shown_x, shown_y;
+		struct predictor predictor;
+	} slot[FEEDBACK_SLOTS];
+	unsigned long motion_events;
+	unsigned long coalesced;	/* motion events never drawn */
+	unsigned long frames;
+};
+
+void feedback_init(struct feedback *, int, double);
+void feedback_set_prediction(struct feedback *, uint64_t);
+void feedback_down(struct feedback *, int, double, double, uint64_t);
+void feedback_motion(struct feedback *, int, double, double, uint64_t);
+void feedback_up(struct feedback *, int);
+void feedback_flush(struct feedback *, uint64_t);
+int feedback_timeout(struct feedback *, uint64_t);
+void feedback_clear(struct feedback *);
+void feedback_print(FILE *, struct feedback *);
+
+#endif /* CALTOOL_FEEDBACK_H */
@@ -0,0 +1,225 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+void
+predictor_reset(struct predictor *p, double x, double y, uint64_t time)
+{
+	p->x = x;
+	p->y = y;
+	p->vx = 0;
+	p->vy = 0;
+	p->time = time;
+}
+
+/*
+ * Alpha-beta filter step: predict to the new time, then correct position
+ * and velocity by a fraction of the residual.
+ */
+void
+predictor_update(struct predictor *p, double x, double y, uint64_t time)
+{
+	double dt, rx, ry;
+
+	if (time <= p->time) {
+		p->x = x;
+		p->y = y;
+		return;
+	}
+	dt = time - p->time;
+
+	rx = x - (p->x + p->vx * dt);
+	ry = y - (p->y + p->vy * dt);
+
+	p->x += p->vx * dt + PREDICTOR_ALPHA * rx;
+	p->y += p->vy * dt + PREDICTOR_ALPHA * ry;
+	p->vx += PREDICTOR_BETA * rx / dt;
+	p->vy += PREDICTOR_BETA * ry / dt;
+	p->time = time;
+}
+
+/* Extrapolated position at the given time */
+void
+predictor_predict(const struct predictor *p, uint64_t time, double *x, double *y)
+{
+	double dt = time > p->time ? (double)(time - p->time) : 0;
+
+	if (dt > PREDICTOR_MAX_USEC)
+		dt = PREDICTOR_MAX_USEC;
+
+	*x = p->x + p->vx * dt;
+	*y = p->y + p->vy * dt;
+}
+
+/*
+ * Filter specification: "none", "median" or "oneeuro[:min_cutoff[,beta]]".
+ * Returns -1 for anything else, leaving the configuration unchanged.
+ */
+int
+sample_filter_parse(struct sample_filter_config *config, const char *spec)
+{
+	struct sample_filter_config c;
+	char *end;
+
+	c.type = SAMPLE_FILTER_NONE;
+	c.min_cutoff = ONE_EURO_MIN_CUTOFF;
+	c.beta = ONE_EURO_BETA;
+
+	if (strcmp(spec, "none") == 0) {
+		c.type = SAMPLE_FILTER_NONE;
+	} else if (strcmp(spec, "median") == 0) {
+		c.type = SAMPLE_FILTER_MEDIAN;
+	} else if (strncmp(spec, "oneeuro", 7) == 0) {
+		c.type = SAMPLE_FILTER_ONE_EURO;
+		spec += 7;
+		if (*spec == ':') {
+			c.min_cutoff = strtod(spec + 1, &end);
+			if (end == spec + 1 || c.min_cutoff <= 0)
+				return -1;
+			spec = end;
+			if (*spec == ',') {
+				c.beta = strtod(spec + 1, &end);
+				if (end == spec + 1 || c.beta < 0)
+					return -1;
+				spec = end;
+			}
+		}
+		if (*spec != '\0')
+			return -1;
+	} else {
+		return -1;
+	}
+
+	*config = c;
+	return 0;
+}
+
+const char *
+sample_filter_name(const struct sample_filter_config *config)
+{
+	switch (config->type) {
+	case SAMPLE_FILTER_MEDIAN:
+		return "median";
+	case SAMPLE_FILTER_ONE_EURO:
+		return "oneeuro";
+	default:
+		return "none";
+	}
+}
+
+/* Forget the positions of the previous contact, keeping the statistics */
+void
+sample_filter_reset(struct sample_filter *f)
+{
+	f->n = 0;
+	f->last_shift = 0;
+}
+
+static double
+median_update(struct filter_axis *a, unsigned long n, double value)
+{
+	double sorted[MEDIAN_TAPS], v;
+	int count, i, j;
+
+	a->taps[n % MEDIAN_TAPS] = value;
+	count = n + 1 < MEDIAN_TAPS ? n + 1 : MEDIAN_TAPS;
+
+	// insertion sort of at most MEDIAN_TAPS values
+	for (i = 0; i < count; i++) {
+		v = a->taps[i];
+		for (j = i; j > 0 && sorted[j - 1] > v; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = v;
+	}
+	if (count % 2)
+		return sorted[count / 2];
+	return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+/* Smoothing factor of a first order low pass with cutoff fc over dt seconds */
+static double
+low_pass_alpha(double fc, double dt)
+{
+	double tau = 1 / (2 * M_PI * fc);
+
+	return dt / (dt + tau);
+}
+
+static double
+one_euro_update(const struct sample_filter_config *c, struct filter_axis *a,
+		double dt, double value)
+{
+	double speed = (value - a->value) / dt;
+
+	a->speed += low_pass_alpha(ONE_EURO_D_CUTOFF, dt) * (speed - a->speed);
+	a->value += low_pass_alpha(c->min_cutoff + c->beta * fabs(a->speed), dt) *
+		(value - a->value);
+	return a->value;
+}
+
+/*
+ * Filter one position in place. Constant work, the first position of a
+ * contact passes unchanged. Returns the distance it was moved.
+ */
+double
+sample_filter_apply(struct sample_filter *f, double *x, double *y, uint64_t time)
+{
+	double fx = *x, fy = *y, dt;
+
+	switch (f->config.type) {
+	case SAMPLE_FILTER_MEDIAN:
+		fx = median_update(&f->x, f->n, *x);
+		fy = median_update(&f->y, f->n, *y);
+		break;
+	case SAMPLE_FILTER_ONE_EURO:
+		if (f->n == 0 || time <= f->time) {
+			if (f->n == 0) {
+				f->x.value = *x;
+				f->y.value = *y;
+				f->x.speed = 0;
+				f->y.speed = 0;
+			}
+			fx = f->x.value;
+			fy = f->y.value;
+			break;
+		}
+		dt = (time - f->time) / 1e6;
+		fx = one_euro_update(&f->config, &f->x, dt, *x);
+		fy = one_euro_update(&f->config, &f->y, dt, *y);
+		break;
+	default:
+		return 0;
+	}
+	f->n++;
+	f->time = time;
+
+	f->last_shift = hypot(fx - *x, fy - *y);
+	if (f->last_shift > f->max_shift)
+		f->max_shift = f->last_shift;
+	running_stats_add(&f->shift, f->last_shift);
+
+	*x = fx;
+	*y = fy;
+	return f->last_shift;
+}
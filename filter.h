@@ -0,0 +1,86 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_FILTER_H
+#define CALTOOL_FILTER_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+/* Gains of the alpha-beta (constant velocity) predictor */
+#define PREDICTOR_ALPHA		0.5
+#define PREDICTOR_BETA		0.1
+
+/* Never extrapolate further than this */
+#define PREDICTOR_MAX_USEC	50000
+
+struct predictor {
+	double x, y;		/* filtered position */
+	double vx, vy;		/* velocity, per usec */
+	uint64_t time;		/* of the last update */
+};
+
+/*
+ * Smoothing of the positions a calibration sample is taken from, either
+ * the median of the last MEDIAN_TAPS positions or a 1-euro filter
+ * (adaptive low pass, cutoff rising with the speed of the contact).
+ */
+#define MEDIAN_TAPS		5
+
+#define ONE_EURO_MIN_CUTOFF	1.0	/* Hz */
+#define ONE_EURO_BETA		0.007	/* per pixel/s */
+#define ONE_EURO_D_CUTOFF	1.0	/* Hz, for the speed estimate */
+
+enum sample_filter_type {
+	SAMPLE_FILTER_NONE,
+	SAMPLE_FILTER_MEDIAN,
+	SAMPLE_FILTER_ONE_EURO
+};
+
+struct sample_filter_config {
+	enum sample_filter_type type;
+	double min_cutoff;
+	double beta;
+};
+
+struct sample_filter {
+	struct sample_filter_config config;
+	unsigned long n;		/* positions since the contact started */
+	uint64_t time;
+	struct filter_axis {
+		double value;		/* 1-euro state */
+		double speed;
+		double taps[MEDIAN_TAPS];	/* median ring */
+	} x, y;
+	double last_shift;		/* pixels the last position was moved */
+	double max_shift;
+	struct running_stats shift;
+};
+
+void predictor_reset(struct predictor *, double, double, uint64_t);
+void predictor_update(struct predictor *, double, double, uint64_t);
+void predictor_predict(const struct predictor *, uint64_t, double *, double *);
+
+int sample_filter_parse(struct sample_filter_config *, const char *);
+const char *sample_filter_name(const struct sample_filter_config *);
+void sample_filter_reset(struct sample_filter *);
+double sample_filter_apply(struct sample_filter *, double *, double *, uint64_t);
+
+#endif /* CALTOOL_FILTER_H */
@@ -0,0 +1,248 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "fixed.h"
+
+/* 1 / SOLVER_DEGENERATE, the same test for collinear points in integers */
+#define FIXED_DEGENERATE	1000000
+
+/* The centered normal sums are rounded to this many bits before products */
+#define FIXED_SUM_BITS		30
+
+fixed_t
+fixed_from_double(double value)
+{
+	value = round(value * FIXED_ONE);
+	if (value > INT32_MAX)
+		return INT32_MAX;
+	if (value < INT32_MIN)
+		return INT32_MIN;
+	return value;
+}
+
+double
+fixed_to_double(fixed_t value)
+{
+	return (double)value / FIXED_ONE;
+}
+
+static fixed_t
+saturate(int64_t value)
+{
+	if (value > INT32_MAX)
+		return INT32_MAX;
+	if (value < INT32_MIN)
+		return INT32_MIN;
+	return value;
+}
+
+/*
+ * value / 2^shift rounded half away from zero. Shifts only non-negative
+ * values, so it does not depend on how the compiler shifts negative ones.
+ */
+static int64_t
+round_shift(int64_t value, int shift)
+{
+	const int64_t half = shift > 0 ? (int64_t)1 << (shift - 1) : 0;
+
+	if (value >= 0)
+		return (value + half) >> shift;
+	return -((-value + half) >> shift);
+}
+
+/*
+ * num * 2^shift / den rounded half away from zero into out, by long
+ * division so num * 2^shift never has to fit 64 bits. Returns -1 if den
+ * is 0 or the result does not fit a fixed_t.
+ */
+static int
+divide(int64_t num, int64_t den, int shift, fixed_t *out)
+{
+	uint64_t n, d, q, r;
+	int i;
+
+	if (den == 0)
+		return -1;
+	n = num < 0 ? -(uint64_t)num : (uint64_t)num;
+	d = den < 0 ? -(uint64_t)den : (uint64_t)den;
+
+	q = n / d;
+	r = n % d;
+	for (i = 0; i < shift; i++) {
+		if (q > INT32_MAX)
+			return -1;
+		q <<= 1;
+		r <<= 1;
+		if (r >= d) {
+			r -= d;
+			q |= 1;
+		}
+	}
+	// 2 r >= d, without the overflow
+	if (r >= d - r)
+		q++;
+	if (q > INT32_MAX)
+		return -1;
+
+	*out = (num < 0) != (den < 0) ? -(int64_t)q : (int64_t)q;
+	return 0;
+}
+
+void
+affine_fixed_transform(const struct affine_fixed *a, fixed_t *x, fixed_t *y)
+{
+	const fixed_t *m = a->m;
+	int64_t tx, ty;
+
+	tx = (int64_t)m[0] * *x + (int64_t)m[1] * *y + (int64_t)m[2] * FIXED_ONE;
+	ty = (int64_t)m[3] * *x + (int64_t)m[4] * *y + (int64_t)m[5] * FIXED_ONE;
+	*x = saturate(round_shift(tx, FIXED_FRAC_BITS));
+	*y = saturate(round_shift(ty, FIXED_FRAC_BITS));
+}
+
+/* Integer device units in, fixed point out, no rounding at all */
+void
+affine_fixed_transform_raw(const struct affine_fixed *a, int32_t x, int32_t y,
+			   fixed_t *u, fixed_t *v)
+{
+	const fixed_t *m = a->m;
+
+	*u = saturate((int64_t)m[0] * x + (int64_t)m[1] * y + m[2]);
+	*v = saturate((int64_t)m[3] * x + (int64_t)m[4] * y + m[5]);
+}
+
+/*
+ * solve_affine3() in integers. Cramer's rule on the edge vectors from the
+ * first point is exact in 64 bits, and so is the offset through the
+ * centroid when it is put over the common denominator 3 det. Every
+ * coefficient is rounded once, by divide().
+ *
+ * Returns -1 for (nearly) collinear points or coefficients out of range.
+ */
+int
+solve_affine3_fixed(struct affine_fixed *a, const fixed_t *x, const fixed_t *y,
+		    const fixed_t *u, const fixed_t *v)
+{
+	int64_t x2 = (int64_t)x[1] - x[0], y2 = (int64_t)y[1] - y[0];
+	int64_t x3 = (int64_t)x[2] - x[0], y3 = (int64_t)y[2] - y[0];
+	int64_t u2 = (int64_t)u[1] - u[0], u3 = (int64_t)u[2] - u[0];
+	int64_t v2 = (int64_t)v[1] - v[0], v3 = (int64_t)v[2] - v[0];
+	int64_t sx = (int64_t)x[0] + x[1] + x[2], sy = (int64_t)y[0] + y[1] + y[2];
+	int64_t su = (int64_t)u[0] + u[1] + u[2], sv = (int64_t)v[0] + v[1] + v[2];
+	int64_t det, edge, num[4];
+	int i;
+
+	det = x2 * y3 - x3 * y2;
+	edge = x2 * x2 + y2 * y2;
+	if (x3 * x3 + y3 * y3 > edge)
+		edge = x3 * x3 + y3 * y3;
+	if (det == 0 || (det < 0 ? -det : det) * FIXED_DEGENERATE <= edge)
+		return -1;
+
+	num[0] = u2 * y3 - u3 * y2;
+	num[1] = x2 * u3 - x3 * u2;
+	num[2] = v2 * y3 - v3 * y2;
+	num[3] = x2 * v3 - x3 * v2;
+	for (i = 0; i < 4; i++) {
+		if (divide(num[i], det, FIXED_FRAC_BITS, &a->m[i < 2 ? i : i + 1]) < 0)
+			return -1;
+	}
+
+	if (divide(su * det - num[0] * sx - num[1] * sy, 3 * det, 0, &a->m[2]) < 0 ||
+	    divide(sv * det - num[2] * sx - num[3] * sy, 3 * det, 0, &a->m[5]) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * solve_affine() in integers, least squares over n >= 3 points. The sums
+ * are exact and centered as n S - s s, which scales the normal equations
+ * by n^2 and keeps them in integers. Those are rounded to FIXED_SUM_BITS
+ * so their products fit 64 bits, then the linear part is solved by
+ * Cramer's rule and the offsets from the sums.
+ *
+ * Returns -1 for (nearly) collinear points or coefficients out of range.
+ */
+int
+solve_affine_fixed(struct affine_fixed *a, const fixed_t *x, const fixed_t *y,
+		   const fixed_t *u, const fixed_t *v, int n)
+{
+	int64_t sx = 0, sy = 0, su = 0, sv = 0;
+	int64_t sxx = 0, sxy = 0, syy = 0, sxu = 0, syu = 0, sxv = 0, syv = 0;
+	int64_t c[7], largest = 0, det, trace;
+	int i, shift = 0;
+
+	if (n < 3 || n > FIXED_MAX_POINTS)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		sx += x[i];
+		sy += y[i];
+		su += u[i];
+		sv += v[i];
+		sxx += (int64_t)x[i] * x[i];
+		sxy += (int64_t)x[i] * y[i];
+		syy += (int64_t)y[i] * y[i];
+		sxu += (int64_t)x[i] * u[i];
+		syu += (int64_t)y[i] * u[i];
+		sxv += (int64_t)x[i] * v[i];
+		syv += (int64_t)y[i] * v[i];
+	}
+
+	// xx, xy, yy, xu, yu, xv, yv around the centroid, times n^2
+	c[0] = n * sxx - sx * sx;
+	c[1] = n * sxy - sx * sy;
+	c[2] = n * syy - sy * sy;
+	c[3] = n * sxu - sx * su;
+	c[4] = n * syu - sy * su;
+	c[5] = n * sxv - sx * sv;
+	c[6] = n * syv - sy * sv;
+
+	for (i = 0; i < 7; i++) {
+		if ((c[i] < 0 ? -c[i] : c[i]) > largest)
+			largest = c[i] < 0 ? -c[i] : c[i];
+	}
+	while ((largest >> shift) >= (int64_t)1 << FIXED_SUM_BITS)
+		shift++;
+	for (i = 0; i < 7; i++)
+		c[i] = round_shift(c[i], shift);
+
+	det = c[0] * c[2] - c[1] * c[1];
+	trace = c[0] + c[2];
+	if (det <= 0 || det <= trace * trace / FIXED_DEGENERATE)
+		return -1;
+
+	if (divide(c[2] * c[3] - c[1] * c[4], det, FIXED_FRAC_BITS, &a->m[0]) < 0 ||
+	    divide(c[0] * c[4] - c[1] * c[3], det, FIXED_FRAC_BITS, &a->m[1]) < 0 ||
+	    divide(c[2] * c[5] - c[1] * c[6], det, FIXED_FRAC_BITS, &a->m[3]) < 0 ||
+	    divide(c[0] * c[6] - c[1] * c[5], det, FIXED_FRAC_BITS, &a->m[4]) < 0)
+		return -1;
+
+	// offsets from the rounded linear part, so they fit what it does
+	if (divide(su * FIXED_ONE - (int64_t)a->m[0] * sx - (int64_t)a->m[1] * sy,
+		   (int64_t)n * FIXED_ONE, 0, &a->m[2]) < 0 ||
+	    divide(sv * FIXED_ONE - (int64_t)a->m[3] * sx - (int64_t)a->m[4] * sy,
+		   (int64_t)n * FIXED_ONE, 0, &a->m[5]) < 0)
+		return -1;
+
+	return 0;
+}
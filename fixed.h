@@ -0,0 +1,90 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_FIXED_H
+#define CALTOOL_FIXED_H
+
+#include <stdint.h>
+
+/*
+ * Integer only calibration math for boards without a (fast) FPU, and for
+ * results that are the same bit for bit on every architecture. Values are
+ * Q(32 - FIXED_FRAC_BITS).FIXED_FRAC_BITS with the sign, Q16.16 by
+ * default. The solvers keep exact 64 bit intermediates only up to 17
+ * fraction bits.
+ */
+#ifndef FIXED_FRAC_BITS
+#define FIXED_FRAC_BITS	16
+#endif
+#if FIXED_FRAC_BITS < 8 || FIXED_FRAC_BITS > 17
+#error "FIXED_FRAC_BITS must be between 8 and 17"
+#endif
+
+#define FIXED_ONE		((fixed_t)1 << FIXED_FRAC_BITS)
+#define FIXED_MAX_POINTS	64
+
+typedef int32_t fixed_t;
+
+/*
+ * Error bounds, with u = 2^-(FIXED_FRAC_BITS + 1) the rounding unit, 7.6e-6
+ * for Q16.16, against double precision evaluation:
+ *
+ * fixed_from_double() is off by at most u.
+ *
+ * affine_fixed_transform() rounds once, so it is within u of the same
+ * coefficients in double. Against the double coefficients they were
+ * rounded from, add u (|x| + |y| + 1): for normalized coordinates that is
+ * 4u in all, 0.024 px on an 800 px axis in Q16.16.
+ *
+ * affine_fixed_transform_raw() takes integer device units, its products
+ * are exact and only the coefficient rounding remains, u (|x| + |y| + 1).
+ *
+ * solve_affine3_fixed() solves in exact integers and rounds once, every
+ * coefficient is within u of the exact solution for its fixed point
+ * inputs. Rounding the inputs perturbs that solution by at most about
+ * 2 u times the condition number solve_affine3() reports.
+ *
+ * solve_affine_fixed() sums exactly and rounds the centered normal
+ * sums to 30 bits before multiplying them, which costs a relative
+ * error of at most 2^-27 times the squared condition number in the
+ * linear part, below u for the layouts of layout.c, then rounds once.
+ * The offsets follow from the rounded linear part and add u (|mean x| +
+ * |mean y|) to that, 3u in all for normalized coordinates.
+ *
+ * The solvers take inputs within (-2, 2), n up to FIXED_MAX_POINTS.
+ */
+
+/* x' = m[0] x + m[1] y + m[2], y' = m[3] x + m[4] y + m[5], as struct affine */
+struct affine_fixed {
+	fixed_t m[6];
+};
+
+fixed_t fixed_from_double(double);
+double fixed_to_double(fixed_t);
+
+void affine_fixed_transform(const struct affine_fixed *, fixed_t *, fixed_t *);
+void affine_fixed_transform_raw(const struct affine_fixed *, int32_t, int32_t,
+				fixed_t *, fixed_t *);
+
+int solve_affine3_fixed(struct affine_fixed *, const fixed_t *, const fixed_t *,
+			const fixed_t *, const fixed_t *);
+int solve_affine_fixed(struct affine_fixed *, const fixed_t *, const fixed_t *,
+		       const fixed_t *, const fixed_t *, int);
+
+#endif /* CALTOOL_FIXED_H */
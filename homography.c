@@ -0,0 +1,297 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "homography.h"
+
+#define DLT_SIZE	9
+#define JACOBI_SWEEPS	50
+
+/*
+ * Similarity taking the points to their centroid with a mean distance of
+ * sqrt(2) from it (Hartley), as a row major 3x3 in t. Returns -1 if all
+ * points coincide.
+ */
+static int
+normalize_points(double *t, const double *x, const double *y, int n)
+{
+	double cx = 0, cy = 0, dist = 0, s;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		cx += x[i];
+		cy += y[i];
+	}
+	cx /= n;
+	cy /= n;
+	for (i = 0; i < n; i++)
+		dist += hypot(x[i] - cx, y[i] - cy);
+	dist /= n;
+	if (dist <= 0)
+		return -1;
+
+	s = M_SQRT2 / dist;
+	memset(t, 0, 9 * sizeof(*t));
+	t[0] = s;
+	t[2] = -s * cx;
+	t[4] = s;
+	t[5] = -s * cy;
+	t[8] = 1;
+	return 0;
+}
+
+static void
+multiply_3x3(double *out, const double *a, const double *b)
+{
+	int r, c;
+
+	for (r = 0; r < 3; r++)
+		for (c = 0; c < 3; c++)
+			out[r * 3 + c] = a[r * 3] * b[c] + a[r * 3 + 1] * b[3 + c] +
+					 a[r * 3 + 2] * b[6 + c];
+}
+
+/*
+ * Eigen decomposition of the symmetric a by cyclic Jacobi rotations, a is
+ * left with the eigenvalues on its diagonal and the columns of v are the
+ * eigenvectors.
+ */
+static void
+jacobi_eigen(double a[DLT_SIZE][DLT_SIZE], double v[DLT_SIZE][DLT_SIZE])
+{
+	double off, theta, t, c, s, tau, g, h;
+	int sweep, p, q, k;
+
+	for (p = 0; p < DLT_SIZE; p++)
+		for (q = 0; q < DLT_SIZE; q++)
+			v[p][q] = p == q;
+
+	for (sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+		off = 0;
+		for (p = 0; p < DLT_SIZE - 1; p++)
+			for (q = p + 1; q < DLT_SIZE; q++)
+				off += a[p][q] * a[p][q];
+		if (off < 1e-30)
+			break;
+
+		for (p = 0; p < DLT_SIZE - 1; p++) {
+			for (q = p + 1; q < DLT_SIZE; q++) {
+				if (a[p][q] == 0)
+					continue;
+				theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+				c = 1 / sqrt(t * t + 1);
+				s = t * c;
+				tau = s / (1 + c);
+
+				h = t * a[p][q];
+				a[p][p] -= h;
+				a[q][q] += h;
+				a[p][q] = a[q][p] = 0;
+				for (k = 0; k < DLT_SIZE; k++) {
+					if (k != p && k != q) {
+						g = a[k][p];
+						h = a[k][q];
+						a[k][p] = a[p][k] = g - s * (h + g * tau);
+						a[k][q] = a[q][k] = h + s * (g - h * tau);
+					}
+					g = v[k][p];
+					h = v[k][q];
+					v[k][p] = g - s * (h + g * tau);
+					v[k][q] = h + s * (g - h * tau);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Homography taking n >= 4 points (x, y) to (u, v), least squares in the
+ * algebraic error by the normalized direct linear transform: both point
+ * sets are normalized, the solution is the eigenvector of the smallest
+ * eigenvalue of A^T A, and the normalization is undone on the result.
+ *
+ * Returns -1 if the points do not determine a homography, three or more
+ * of four on a line for example, or if it takes the points to infinity.
+ */
+int
+solve_homography(struct homography *m, const double *x, const double *y,
+		 const double *u, const double *v, int n)
+{
+	double ata[DLT_SIZE][DLT_SIZE], vec[DLT_SIZE][DLT_SIZE];
+	double row[2][DLT_SIZE];
+	double t1[9], t2[9], t2_inv[9], hn[9], tmp[9];
+	double px, py, pu, pv, next, hi, scale;
+	int i, j, k, r, best;
+
+	if (n < 4)
+		return -1;
+	if (normalize_points(t1, x, y, n) < 0 || normalize_points(t2, u, v, n) < 0)
+		return -1;
+
+	memset(ata, 0, sizeof(ata));
+	for (i = 0; i < n; i++) {
+		px = t1[0] * x[i] + t1[2];
+		py = t1[4] * y[i] + t1[5];
+		pu = t2[0] * u[i] + t2[2];
+		pv = t2[4] * v[i] + t2[5];
+
+		memset(row, 0, sizeof(row));
+		row[0][0] = row[1][3] = px;
+		row[0][1] = row[1][4] = py;
+		row[0][2] = row[1][5] = 1;
+		row[0][6] = -pu * px;
+		row[0][7] = -pu * py;
+		row[0][8] = -pu;
+		row[1][6] = -pv * px;
+		row[1][7] = -pv * py;
+		row[1][8] = -pv;
+		for (r = 0; r < 2; r++)
+			for (j = 0; j < DLT_SIZE; j++)
+				for (k = j; k < DLT_SIZE; k++)
+					ata[j][k] += row[r][j] * row[r][k];
+	}
+	for (j = 0; j < DLT_SIZE; j++)
+		for (k = 0; k < j; k++)
+			ata[j][k] = ata[k][j];
+
+	jacobi_eigen(ata, vec);
+
+	best = 0;
+	hi = ata[0][0];
+	for (j = 1; j < DLT_SIZE; j++) {
+		if (ata[j][j] < ata[best][best])
+			best = j;
+		hi = fmax(hi, ata[j][j]);
+	}
+	next = INFINITY;
+	for (j = 0; j < DLT_SIZE; j++)
+		if (j != best)
+			next = fmin(next, ata[j][j]);
+
+	// a second (near) null vector leaves the solution undetermined
+	if (next <= 1e-12 * hi)
+		return -1;
+
+	for (j = 0; j < DLT_SIZE; j++)
+		hn[j] = vec[j][best];
+
+	// H = T2^-1 Hn T1
+	memset(t2_inv, 0, sizeof(t2_inv));
+	t2_inv[0] = 1 / t2[0];
+	t2_inv[2] = -t2[2] / t2[0];
+	t2_inv[4] = 1 / t2[4];
+	t2_inv[5] = -t2[5] / t2[4];
+	t2_inv[8] = 1;
+	multiply_3x3(tmp, hn, t1);
+	multiply_3x3(m->h, t2_inv, tmp);
+
+	scale = m->h[8];
+	if (fabs(scale) < 1e-12 * (fabs(m->h[0]) + fabs(m->h[4])))
+		return -1;
+	for (j = 0; j < 9; j++)
+		m->h[j] /= scale;
+
+	for (i = 0; i < n; i++) {
+		if (fabs(m->h[6] * x[i] + m->h[7] * y[i] + 1) < 1e-9)
+			return -1;
+	}
+	return 0;
+}
+
+/* Per event, 8 multiplications and a division */
+int
+homography_transform(const struct homography *m, double *x, double *y)
+{
+	const double *h = m->h;
+	double w = h[6] * *x + h[7] * *y + h[8];
+	double tx;
+
+	if (w == 0)
+		return -1;
+	w = 1 / w;
+	tx = (h[0] * *x + h[1] * *y + h[2]) * w;
+	*y = (h[3] * *x + h[4] * *y + h[5]) * w;
+	*x = tx;
+	return 0;
+}
+
+/*
+ * Fitted minus wanted position of each point into du and dv, either may
+ * be NULL. Returns the RMS of the residual lengths.
+ */
+double
+homography_residuals(const struct homography *m, const double *x, const double *y,
+		     const double *u, const double *v, int n, double *du, double *dv)
+{
+	double tx, ty, sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		tx = x[i];
+		ty = y[i];
+		homography_transform(m, &tx, &ty);
+		if (du)
+			du[i] = tx - u[i];
+		if (dv)
+			dv[i] = ty - v[i];
+		sum += (tx - u[i]) * (tx - u[i]) + (ty - v[i]) * (ty - v[i]);
+	}
+	return n > 0 ? sqrt(sum / n) : 0;
+}
+
+/*
+ * In the layout of the calibration matrices, applied to (x, y, 1, 1):
+ * offsets in d[8] and d[9], the perspective row in d[3], d[7] and d[15],
+ * so w' is the denominator. Affine matrices read back with h[6] = h[7] = 0.
+ */
+void
+homography_from_matrix(struct homography *m, const struct weston_matrix *matrix)
+{
+	const float *d = matrix->d;
+
+	m->h[0] = d[0];
+	m->h[1] = d[4];
+	m->h[2] = d[8] + d[12];
+	m->h[3] = d[1];
+	m->h[4] = d[5];
+	m->h[5] = d[9] + d[13];
+	m->h[6] = d[3];
+	m->h[7] = d[7];
+	m->h[8] = d[11] + d[15];
+}
+
+void
+homography_to_matrix(struct weston_matrix *matrix, const struct homography *m)
+{
+	memset(matrix, 0, sizeof(*matrix));
+	matrix->d[0] = m->h[0];
+	matrix->d[4] = m->h[1];
+	matrix->d[8] = m->h[2];
+	matrix->d[1] = m->h[3];
+	matrix->d[5] = m->h[4];
+	matrix->d[9] = m->h[5];
+	matrix->d[3] = m->h[6];
+	matrix->d[7] = m->h[7];
+	matrix->d[15] = m->h[8];
+	matrix->d[10] = 1;
+	matrix->type = WESTON_MATRIX_TRANSFORM_OTHER;
+}
@@ -0,0 +1,56 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_HOMOGRAPHY_H
+#define CALTOOL_HOMOGRAPHY_H
+
+#include "matrix.h"
+
+/*
+ * The projective model wins over the affine one only if it takes the RMS
+ * error below this fraction of the affine error, and by at least
+ * PROJECTIVE_MIN_PX. Four points fit any homography exactly, so it also
+ * needs one more than that to be judged at all.
+ */
+#define PROJECTIVE_MIN_POINTS	5
+#define PROJECTIVE_GAIN		0.7
+#define PROJECTIVE_MIN_PX	0.5
+
+/*
+ *      h[0] x + h[1] y + h[2]        h[3] x + h[4] y + h[5]
+ * x' = ----------------------   y' = ----------------------
+ *      h[6] x + h[7] y + h[8]        h[6] x + h[7] y + h[8]
+ *
+ * Scaled to h[8] = 1 by the solver.
+ */
+struct homography {
+	double h[9];
+};
+
+int solve_homography(struct homography *, const double *, const double *,
+		     const double *, const double *, int);
+double homography_residuals(const struct homography *, const double *, const double *,
+			    const double *, const double *, int, double *, double *);
+
+int homography_transform(const struct homography *, double *, double *);
+
+void homography_from_matrix(struct homography *, const struct weston_matrix *);
+void homography_to_matrix(struct weston_matrix *, const struct homography *);
+
+#endif /* CALTOOL_HOMOGRAPHY_H */
@@ -0,0 +1,143 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+#include "solver.h"
+
+/* The original three targets */
+static const struct test_ratio triangle[] = {
+	{ 0.20, 0.40 },
+	{ 0.80, 0.60 },
+	{ 0.40, 0.80 }
+};
+
+/* Corners and center */
+static const struct test_ratio corners[] = {
+	{ 0.10, 0.10 },
+	{ 0.90, 0.10 },
+	{ 0.50, 0.50 },
+	{ 0.10, 0.90 },
+	{ 0.90, 0.90 }
+};
+
+/* Square grid of size x size targets from 10% to 90% of the screen */
+static void
+layout_grid(struct test_layout *layout, int size)
+{
+	int row, col;
+
+	layout->num = 0;
+	for (row = 0; row < size; row++) {
+		for (col = 0; col < size; col++) {
+			layout->ratio[layout->num].x_ratio = 0.1 + 0.8 * col / (size - 1);
+			layout->ratio[layout->num].y_ratio = 0.1 + 0.8 * row / (size - 1);
+			layout->num++;
+		}
+	}
+}
+
+static void
+layout_copy(struct test_layout *layout, const struct test_ratio *ratio, int num)
+{
+	memcpy(layout->ratio, ratio, num * sizeof(*ratio));
+	layout->num = num;
+}
+
+/*
+ * True if the targets lie on a line, by the test solve_affine_weighted()
+ * applies to the samples: no calibration could be solved from them.
+ */
+static int
+layout_collinear(const struct test_layout *layout)
+{
+	double cx = 0, cy = 0, sxx = 0, sxy = 0, syy = 0, dx, dy;
+	int i;
+
+	for (i = 0; i < layout->num; i++) {
+		cx += layout->ratio[i].x_ratio;
+		cy += layout->ratio[i].y_ratio;
+	}
+	cx /= layout->num;
+	cy /= layout->num;
+	for (i = 0; i < layout->num; i++) {
+		dx = layout->ratio[i].x_ratio - cx;
+		dy = layout->ratio[i].y_ratio - cy;
+		sxx += dx * dx;
+		sxy += dx * dy;
+		syy += dy * dy;
+	}
+	return sxx * syy - sxy * sxy <= SOLVER_DEGENERATE * (sxx + syy) * (sxx + syy);
+}
+
+/*
+ * Layout specification: 3, 5, 9 or 25 for the built-in layouts, or at
+ * least three "x,y" ratios separated by ';', e.g. "0.1,0.1;0.9,0.5;0.1,0.9",
+ * that are not all on one line. Returns -1 for anything else, leaving the
+ * layout unchanged.
+ */
+int
+layout_parse(struct test_layout *layout, const char *spec)
+{
+	struct test_layout l;
+	char *end;
+
+	if (strcmp(spec, "3") == 0) {
+		layout_copy(layout, triangle, 3);
+		return 0;
+	}
+	if (strcmp(spec, "5") == 0) {
+		layout_copy(layout, corners, 5);
+		return 0;
+	}
+	if (strcmp(spec, "9") == 0) {
+		layout_grid(layout, 3);
+		return 0;
+	}
+	if (strcmp(spec, "25") == 0) {
+		layout_grid(layout, 5);
+		return 0;
+	}
+
+	l.num = 0;
+	while (*spec != '\0') {
+		if (l.num >= MAX_TESTS)
+			return -1;
+		l.ratio[l.num].x_ratio = strtod(spec, &end);
+		if (end == spec || *end != ',')
+			return -1;
+		spec = end + 1;
+		l.ratio[l.num].y_ratio = strtod(spec, &end);
+		if (end == spec || (*end != ';' && *end != '\0'))
+			return -1;
+		spec = *end == ';' ? end + 1 : end;
+
+		if (l.ratio[l.num].x_ratio < 0 || l.ratio[l.num].x_ratio > 1 ||
+		    l.ratio[l.num].y_ratio < 0 || l.ratio[l.num].y_ratio > 1)
+			return -1;
+		l.num++;
+	}
+	if (l.num < 3 || layout_collinear(&l))
+		return -1;
+
+	*layout = l;
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_LAYOUT_H
+#define CALTOOL_LAYOUT_H
+
+/* Most targets of a calibration session */
+#define MAX_TESTS	25
+
+/* Built-in layout unless -p selects another */
+#define LAYOUT_DEFAULT	"3"
+
+/*
+ * Target positions as fractions of the screen size. The points for the
+ * calibration must not all be on a line.
+ */
+struct test_layout {
+	int num;
+	struct test_ratio {
+		float x_ratio, y_ratio;
+	} ratio[MAX_TESTS];
+};
+
+int layout_parse(struct test_layout *, const char *);
+
+#endif /* CALTOOL_LAYOUT_H */
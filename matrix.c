@@ -27,6 +27,7 @@
 #include <math.h>
 
 #include "matrix.h"
+#include "matrix_simd.h"
 
 
 /*
@@ -52,21 +53,27 @@ weston_matrix_init(struct weston_matrix *matrix)
 void
 weston_matrix_multiply(struct weston_matrix *m, const struct weston_matrix *n)
 {
-	struct weston_matrix tmp;
+	matrix_kernels()->multiply(m->d, n->d);
+	m->type |= n->type;
+}
+
+void
+matrix_multiply_scalar(float *m, const float *n)
+{
+	float tmp[16];
 	const float *row, *column;
 	div_t d;
 	int i, j;
 
 	for (i = 0; i < 16; i++) {
-		tmp.d[i] = 0;
+		tmp[i] = 0;
 		d = div(i, 4);
-		row = m->d + d.quot * 4;
-		column = n->d + d.rem;
+		row = m + d.quot * 4;
+		column = n + d.rem;
 		for (j = 0; j < 4; j++)
-			tmp.d[i] += row[j] * column[j * 4];
+			tmp[i] += row[j] * column[j * 4];
 	}
-	tmp.type = m->type | n->type;
-	memcpy(m, &tmp, sizeof tmp);
+	memcpy(m, tmp, sizeof tmp);
 }
 
 void
@@ -105,17 +112,23 @@ weston_matrix_rotate_xy(struct weston_matrix *matrix, float cos, float sin)
 /* v <- m * v */
 void
 weston_matrix_transform(struct weston_matrix *matrix, struct weston_vector *v)
+{
+	matrix_kernels()->transform(matrix->d, v->f);
+}
+
+void
+matrix_transform_scalar(const float *m, float *v)
 {
 	int i, j;
-	struct weston_vector t;
+	float t[4];
 
 	for (i = 0; i < 4; i++) {
-		t.f[i] = 0;
+		t[i] = 0;
 		for (j = 0; j < 4; j++)
-			t.f[i] += v->f[j] * matrix->d[i + j * 4];
+			t[i] += v[j] * m[i + j * 4];
 	}
 
-	*v = t;
+	memcpy(v, t, sizeof t);
 }
 
 static inline void
@@ -159,7 +172,7 @@ find_pivot(double *column, unsigned k)
  */
 
 MATRIX_TEST_EXPORT inline int
-matrix_invert(double *A, unsigned *p, const struct weston_matrix *matrix)
+matrix_invert(double *A, unsigned *p, const float *matrix)
 {
 	unsigned i, j, k;
 	unsigned pivot;
@@ -168,7 +181,7 @@ matrix_invert(double *A, unsigned *p, const struct weston_matrix *matrix)
 	for (i = 0; i < 4; ++i)
 		p[i] = i;
 	for (i = 16; i--; )
-		A[i] = matrix->d[i];
+		A[i] = matrix[i];
 
 	/* LU decomposition with partial pivoting */
 	for (k = 0; k < 4; ++k) {
@@ -246,9 +259,11 @@ inverse_transform(const double *LU, const unsigned *p, float *v)
 }
 
 int
-weston_matrix_invert(struct weston_matrix *inverse,
-		     const struct weston_matrix *matrix)
+matrix_invert_scalar(float *inverse, const float *matrix)
 {
+	static const float identity[16] = {
+		1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1
+	};
 	double LU[16];		/* column-major */
 	unsigned perm[4];	/* permutation */
 	unsigned c;
@@ -256,10 +271,22 @@ weston_matrix_invert(struct weston_matrix *inverse,
 	if (matrix_invert(LU, perm, matrix) < 0)
 		return -1;
 
-	weston_matrix_init(inverse);
+	memcpy(inverse, identity, sizeof identity);
 	for (c = 0; c < 4; ++c)
-		inverse_transform(LU, perm, &inverse->d[c * 4]);
-	inverse->type = matrix->type;
+		inverse_transform(LU, perm, &inverse[c * 4]);
+
+	return 0;
+}
+
+int
+weston_matrix_invert(struct weston_matrix *inverse,
+		     const struct weston_matrix *matrix)
+{
+	unsigned type = matrix->type;
+
+	if (matrix_kernels()->invert(inverse->d, matrix->d) < 0)
+		return -1;
+	inverse->type = type;
 
 	return 0;
 }
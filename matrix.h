@@ -62,7 +62,7 @@ weston_matrix_invert(struct weston_matrix *inverse,
 #  define MATRIX_TEST_EXPORT WL_EXPORT
 
 int
-matrix_invert(double *A, unsigned *p, const struct weston_matrix *matrix);
+matrix_invert(double *A, unsigned *p, const float *matrix);
 
 void
 inverse_transform(const double *LU, const unsigned *p, float *v);
@@ -0,0 +1,422 @@
+/*
+	matrix_bench - point transform throughput for caltool - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Transforms a buffer of random raw touch positions with a calibration
+ * matrix, one point at a time through weston_matrix_transform() and in
+ * batches, for every kernel set the CPU supports, and in integers through
+ * fixed.h. The affine.h fast paths of scale, rotation and general maps are
+ * timed next to weston_matrix_transform(), and inverted back to the raw
+ * positions. Prints points/s and the largest deviation from a double
+ * precision reference. A correction grid is also written, read back and
+ * applied, its error is against the grid before saving. The batch kernels
+ * are always built with -O2, the other rows follow CFLAGS and are only
+ * meaningful from an optimized build, e.g. make CFLAGS="-O2 -g".
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "affine.h"
+#include "correction.h"
+#include "fixed.h"
+#include "matrix.h"
+#include "matrix_simd.h"
+#include "stats.h"
+#include "version.h"
+
+#ifdef __OPTIMIZE__
+#define BENCH_BUILD	"optimized"
+#else
+#define BENCH_BUILD	"unoptimized, kernels -O2"
+#endif
+
+static const char *kernel_names[] = { "scalar", "sse2", "avx2", "neon" };
+
+static size_t points = 4096;
+static unsigned int rounds = 1000;
+static unsigned int seed = 1;
+
+static int32_t *raw_x, *raw_y;
+static fixed_t *out_fx, *out_fy;
+static float *in_x, *in_y, *out_x, *out_y;
+static double *in_dx, *in_dy, *out_dx, *out_dy;
+static double *ref_x, *ref_y;
+static double checksum;
+
+static void *
+alloc_points(size_t size)
+{
+	void *p = malloc(points * size);
+
+	if (p == NULL) {
+		printf("Error: out of memory !!\n");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+static double
+max_error(const float *x, const float *y)
+{
+	double err = 0;
+	size_t i;
+
+	for (i = 0; i < points; i++) {
+		err = fmax(err, fabs(x[i] - ref_x[i]));
+		err = fmax(err, fabs(y[i] - ref_y[i]));
+	}
+	return err;
+}
+
+static double
+max_error_double(const double *x, const double *y)
+{
+	double err = 0;
+	size_t i;
+
+	for (i = 0; i < points; i++) {
+		err = fmax(err, fabs(x[i] - ref_x[i]));
+		err = fmax(err, fabs(y[i] - ref_y[i]));
+	}
+	return err;
+}
+
+static void
+report(const char *kernel, const char *path, uint64_t usec, double err)
+{
+	double rate = usec ? (double)points * rounds / usec : 0;
+
+	printf("%-7s %-8s %8.1f Mpoints/s  max error %g\n", kernel, path, rate, err);
+	checksum += out_x[0] + out_y[points - 1] + out_dx[0] + out_dy[points - 1];
+}
+
+static void
+bench_kernels(const char *name, const struct weston_matrix *m)
+{
+	struct weston_vector v;
+	uint64_t start;
+	unsigned int r;
+	size_t i;
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++) {
+			v.f[0] = in_x[i];
+			v.f[1] = in_y[i];
+			v.f[2] = 1;
+			v.f[3] = 1;
+			weston_matrix_transform((struct weston_matrix *)m, &v);
+			out_x[i] = v.f[0];
+			out_y[i] = v.f[1];
+		}
+	}
+	report(name, "single", monotonic_usec() - start, max_error(out_x, out_y));
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++)
+		matrix_transform_points(m, in_x, in_y, out_x, out_y, points);
+	report(name, "float", monotonic_usec() - start, max_error(out_x, out_y));
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++)
+		matrix_transform_points_double(m, in_dx, in_dy, out_dx, out_dy, points);
+	report(name, "double", monotonic_usec() - start, max_error_double(out_dx, out_dy));
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++)
+		matrix_transform_points_raw(m, raw_x, raw_y, out_x, out_y, points);
+	report(name, "raw", monotonic_usec() - start, max_error(out_x, out_y));
+}
+
+/* Integer only, device units to fixed point pixels */
+static void
+bench_fixed(const struct weston_matrix *m)
+{
+	struct affine_fixed a;
+	uint64_t start, usec;
+	unsigned int r;
+	size_t i;
+
+	a.m[0] = fixed_from_double(m->d[0]);
+	a.m[1] = fixed_from_double(m->d[4]);
+	a.m[2] = fixed_from_double(m->d[8]);
+	a.m[3] = fixed_from_double(m->d[1]);
+	a.m[4] = fixed_from_double(m->d[5]);
+	a.m[5] = fixed_from_double(m->d[9]);
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++)
+			affine_fixed_transform_raw(&a, raw_x[i], raw_y[i], &out_fx[i], &out_fy[i]);
+	}
+	usec = monotonic_usec() - start;
+
+	for (i = 0; i < points; i++) {
+		out_x[i] = fixed_to_double(out_fx[i]);
+		out_y[i] = fixed_to_double(out_fy[i]);
+	}
+	report("fixed", "raw", usec, max_error(out_x, out_y));
+}
+
+/*
+ * One point at a time in doubles through affine_transform(), whose type
+ * flags skip the zero coefficients, against weston_matrix_transform().
+ * The inverse from affine_invert() has to bring the raw positions back.
+ */
+static void
+bench_affine(const char *name, const float *coef)
+{
+	struct weston_matrix m;
+	struct weston_vector v;
+	struct affine a, inverse;
+	double err, x, y;
+	uint64_t start, usec;
+	unsigned int r;
+	size_t i;
+
+	affine_set(&a, coef);
+	affine_to_matrix(&m, &a);
+	if (affine_invert(&inverse, &a) < 0) {
+		printf("Error: %s map not invertible !!\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++) {
+			v.f[0] = in_x[i];
+			v.f[1] = in_y[i];
+			v.f[2] = 1;
+			v.f[3] = 1;
+			weston_matrix_transform(&m, &v);
+			out_x[i] = v.f[0];
+			out_y[i] = v.f[1];
+		}
+	}
+	usec = monotonic_usec() - start;
+	err = 0;
+	for (i = 0; i < points; i++) {
+		err = fmax(err, fabs(out_x[i] - ((double)coef[0] * in_dx[i] + (double)coef[1] * in_dy[i] + coef[2])));
+		err = fmax(err, fabs(out_y[i] - ((double)coef[3] * in_dx[i] + (double)coef[4] * in_dy[i] + coef[5])));
+	}
+	report(name, "weston", usec, err);
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++) {
+			out_dx[i] = in_dx[i];
+			out_dy[i] = in_dy[i];
+			affine_transform(&a, &out_dx[i], &out_dy[i]);
+		}
+	}
+	usec = monotonic_usec() - start;
+	err = 0;
+	for (i = 0; i < points; i++) {
+		err = fmax(err, fabs(out_dx[i] - ((double)coef[0] * in_dx[i] + (double)coef[1] * in_dy[i] + coef[2])));
+		err = fmax(err, fabs(out_dy[i] - ((double)coef[3] * in_dx[i] + (double)coef[4] * in_dy[i] + coef[5])));
+	}
+	report(name, "affine", usec, err);
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++) {
+			x = out_dx[i];
+			y = out_dy[i];
+			affine_transform(&inverse, &x, &y);
+			in_x[i] = x;
+			in_y[i] = y;
+		}
+	}
+	usec = monotonic_usec() - start;
+	err = 0;
+	for (i = 0; i < points; i++) {
+		err = fmax(err, fabs(in_x[i] - in_dx[i]));
+		err = fmax(err, fabs(in_y[i] - in_dy[i]));
+		in_x[i] = in_dx[i];
+		in_y[i] = in_dy[i];
+	}
+	report(name, "inverse", usec, err);
+}
+
+/* Round trip through correction_save() and correction_load(), then apply */
+static void
+bench_correction(void)
+{
+	struct correction_grid grid, loaded;
+	struct correction_poly poly;
+	char path[] = "/tmp/matrix_bench.XXXXXX";
+	double x, y, err = 0;
+	uint64_t start, usec;
+	unsigned int r;
+	size_t i;
+	int fd, rc = -1;
+
+	// a quadratic bow of a few pixels, after a projective model
+	memset(&poly, 0, sizeof(poly));
+	poly.degree = 2;
+	poly.terms = 6;
+	poly.cx[0] = 0.002;
+	poly.cx[2] = -0.004;
+	poly.cx[5] = 0.003;
+	poly.cy[0] = -0.001;
+	poly.cy[3] = 0.005;
+	poly.cy[4] = -0.002;
+	correction_bake(&grid, &poly);
+	grid.base = CORRECTION_PROJECTIVE;
+
+	fd = mkstemp(path);
+	if (fd >= 0) {
+		close(fd);
+		if (correction_save(&grid, path) == 0 && correction_load(&loaded, path) == 0)
+			rc = 0;
+		unlink(path);
+	}
+	if (rc < 0 || loaded.base != grid.base) {
+		printf("Error: correction grid round trip failed !!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	start = monotonic_usec();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < points; i++) {
+			out_dx[i] = in_dx[i] / 4096;
+			out_dy[i] = in_dy[i] / 4096;
+			correction_apply(&loaded, &out_dx[i], &out_dy[i]);
+		}
+	}
+	usec = monotonic_usec() - start;
+
+	for (i = 0; i < points; i++) {
+		x = in_dx[i] / 4096;
+		y = in_dy[i] / 4096;
+		correction_apply(&grid, &x, &y);
+		err = fmax(err, fabs(out_dx[i] - x));
+		err = fmax(err, fabs(out_dy[i] - y));
+	}
+	report("grid", "apply", usec, err);
+}
+
+static void
+usage(void)
+{
+	printf("Usage: matrix_bench [OPTION]\n\n"
+	       "  -v              			print version information\n"
+	       "  -n [points]     			points per batch\n"
+	       "  -r [rounds]     			batches per measurement\n"
+	       "  -S [seed]       			seed of the raw positions\n"
+	       "\n");
+}
+
+int main(int argc, char **argv)
+{
+	const struct matrix_kernels *k;
+	const float scale_map[6] = { 0.1953125, 0, -4, 0, 0.1171875, 2 };
+	const float rotate_map[6] = { 0, -0.1953125, 800, 0.1171875, 0, 0 };
+	float other_map[6];
+	struct weston_matrix m;
+	struct affine a;
+	unsigned int i;
+	size_t p;
+	int c;
+
+	while ((c = getopt(argc, argv, "vn:r:S:")) != -1) {
+		switch (c) {
+		case 'v':
+			printf("matrix_bench V%c.%c RELEASE %c build: %s %s\n", VERSION_MAJOR, VERSION_MINOR, VERSION_RELEASE, __DATE__, __TIME__);
+			exit(EXIT_FAILURE);
+		case 'n':
+			points = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (points < 1 || rounds < 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	raw_x = alloc_points(sizeof(*raw_x));
+	raw_y = alloc_points(sizeof(*raw_y));
+	out_fx = alloc_points(sizeof(*out_fx));
+	out_fy = alloc_points(sizeof(*out_fy));
+	in_x = alloc_points(sizeof(*in_x));
+	in_y = alloc_points(sizeof(*in_y));
+	out_x = alloc_points(sizeof(*out_x));
+	out_y = alloc_points(sizeof(*out_y));
+	in_dx = alloc_points(sizeof(*in_dx));
+	in_dy = alloc_points(sizeof(*in_dy));
+	out_dx = alloc_points(sizeof(*out_dx));
+	out_dy = alloc_points(sizeof(*out_dy));
+	ref_x = alloc_points(sizeof(*ref_x));
+	ref_y = alloc_points(sizeof(*ref_y));
+
+	// a calibration matrix in the layout of finish_calibration(), raw units to pixels
+	memset(&m, 0, sizeof(m));
+	m.d[0] = 0.19;
+	m.d[4] = 0.004;
+	m.d[8] = -12.5;
+	m.d[1] = -0.002;
+	m.d[5] = 0.118;
+	m.d[9] = 7.25;
+	m.d[10] = 1;
+	m.d[15] = 1;
+	affine_from_matrix(&a, &m);
+	memcpy(other_map, a.m, sizeof(other_map));
+
+	for (p = 0; p < points; p++) {
+		raw_x[p] = rand_r(&seed) % 4096;
+		raw_y[p] = rand_r(&seed) % 4096;
+		in_x[p] = in_dx[p] = raw_x[p];
+		in_y[p] = in_dy[p] = raw_y[p];
+		ref_x[p] = (double)m.d[0] * raw_x[p] + (double)m.d[4] * raw_y[p] + m.d[8];
+		ref_y[p] = (double)m.d[1] * raw_x[p] + (double)m.d[5] * raw_y[p] + m.d[9];
+	}
+
+	printf("%zu points x %u rounds, default kernels %s, build %s\n", points, rounds,
+	       matrix_kernels()->name, BENCH_BUILD);
+	for (i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); i++) {
+		k = matrix_kernels_find(kernel_names[i]);
+		if (k == NULL)
+			continue;
+		matrix_kernels_use(k);
+		bench_kernels(k->name, &m);
+	}
+	bench_fixed(&m);
+
+	// a panel that only needs scaling, one mounted at 90 degrees, and the matrix above
+	bench_affine("scale", scale_map);
+	bench_affine("rotate", rotate_map);
+	bench_affine("other", other_map);
+	bench_correction();
+
+	// keeps the results alive
+	return checksum == 42 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
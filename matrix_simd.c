@@ -0,0 +1,267 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+#include "matrix_simd.h"
+
+#if defined(__arm__) && !defined(HWCAP_NEON)
+#define HWCAP_NEON	(1 << 12)
+#endif
+
+/* GCC generic vectors, lowered to SSE, AVX or NEON by the target */
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+typedef float v8sf __attribute__((vector_size(32)));
+typedef int32_t v8si __attribute__((vector_size(32)));
+typedef double v4df __attribute__((vector_size(32)));
+
+static inline v4sf
+v4sf_load(const float *p)
+{
+	v4sf v;
+
+	// struct weston_matrix only guarantees float alignment
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void
+v4sf_store(float *p, v4sf v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/* 32 byte vectors are passed by reference, their ABI depends on AVX */
+static inline void
+v8sf_load(v8sf *v, const float *p)
+{
+	memcpy(v, p, sizeof(*v));
+}
+
+static inline void
+v8sf_store(float *p, const v8sf *v)
+{
+	memcpy(p, v, sizeof(*v));
+}
+
+static inline void
+v8si_load(v8si *v, const int32_t *p)
+{
+	memcpy(v, p, sizeof(*v));
+}
+
+static inline void
+v4df_load(v4df *v, const double *p)
+{
+	memcpy(v, p, sizeof(*v));
+}
+
+static inline void
+v4df_store(double *p, const v4df *v)
+{
+	memcpy(p, v, sizeof(*v));
+}
+
+static void
+points_float_scalar(const float *m, const float *x, const float *y,
+		    float *out_x, float *out_y, size_t n)
+{
+	float tx;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		tx = x[i] * m[0] + y[i] * m[4] + m[8] + m[12];
+		out_y[i] = x[i] * m[1] + y[i] * m[5] + m[9] + m[13];
+		out_x[i] = tx;
+	}
+}
+
+static void
+points_double_scalar(const float *m, const double *x, const double *y,
+		     double *out_x, double *out_y, size_t n)
+{
+	double tx;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		tx = x[i] * m[0] + y[i] * m[4] + m[8] + m[12];
+		out_y[i] = x[i] * m[1] + y[i] * m[5] + m[9] + m[13];
+		out_x[i] = tx;
+	}
+}
+
+static void
+points_raw_scalar(const float *m, const int32_t *x, const int32_t *y,
+		  float *out_x, float *out_y, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		out_x[i] = x[i] * m[0] + y[i] * m[4] + m[8] + m[12];
+		out_y[i] = x[i] * m[1] + y[i] * m[5] + m[9] + m[13];
+	}
+}
+
+static const struct matrix_kernels scalar_kernels = {
+	"scalar", matrix_multiply_scalar, matrix_transform_scalar, matrix_invert_scalar,
+	points_float_scalar, points_double_scalar, points_raw_scalar
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define KERNEL(name) name##_sse2
+#include "matrix_simd_kernels.h"
+#undef KERNEL
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define KERNEL(name) name##_avx2
+#include "matrix_simd_kernels.h"
+#undef KERNEL
+#pragma GCC pop_options
+
+static const struct matrix_kernels vector_kernels[] = {
+	{ "avx2", multiply_avx2, transform_avx2, invert_avx2,
+	  points_float_avx2, points_double_avx2, points_raw_avx2 },
+	{ "sse2", multiply_sse2, transform_sse2, invert_sse2,
+	  points_float_sse2, points_double_sse2, points_raw_sse2 },
+};
+
+static int
+kernels_supported(const struct matrix_kernels *k)
+{
+	__builtin_cpu_init();
+	if (k->multiply == multiply_avx2)
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return __builtin_cpu_supports("sse2");
+}
+
+#elif defined(__arm__) || defined(__aarch64__)
+
+#if defined(__arm__)
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#endif
+#define KERNEL(name) name##_neon
+#include "matrix_simd_kernels.h"
+#undef KERNEL
+#if defined(__arm__)
+#pragma GCC pop_options
+#endif
+
+static const struct matrix_kernels vector_kernels[] = {
+	{ "neon", multiply_neon, transform_neon, invert_neon,
+	  points_float_neon, points_double_neon, points_raw_neon },
+};
+
+static int
+kernels_supported(const struct matrix_kernels *k)
+{
+#if defined(__arm__)
+	return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+	// Advanced SIMD is mandatory on AArch64
+	return 1;
+#endif
+}
+
+#else
+
+static const struct matrix_kernels vector_kernels[] = {};
+
+static int
+kernels_supported(const struct matrix_kernels *k)
+{
+	return 0;
+}
+
+#endif
+
+static const struct matrix_kernels *kernels;
+
+/* Best supported kernels, in order of preference */
+const struct matrix_kernels *
+matrix_kernels(void)
+{
+	unsigned i;
+
+	if (kernels)
+		return kernels;
+
+	kernels = &scalar_kernels;
+	for (i = 0; i < sizeof(vector_kernels) / sizeof(vector_kernels[0]); i++) {
+		if (kernels_supported(&vector_kernels[i])) {
+			kernels = &vector_kernels[i];
+			break;
+		}
+	}
+	return kernels;
+}
+
+/* Kernels by name, NULL if unknown or not supported by this CPU */
+const struct matrix_kernels *
+matrix_kernels_find(const char *name)
+{
+	unsigned i;
+
+	if (strcmp(name, scalar_kernels.name) == 0)
+		return &scalar_kernels;
+
+	for (i = 0; i < sizeof(vector_kernels) / sizeof(vector_kernels[0]); i++) {
+		if (strcmp(name, vector_kernels[i].name) == 0)
+			return kernels_supported(&vector_kernels[i]) ? &vector_kernels[i] : NULL;
+	}
+	return NULL;
+}
+
+void
+matrix_kernels_use(const struct matrix_kernels *k)
+{
+	kernels = k;
+}
+
+void
+matrix_transform_points(const struct weston_matrix *m, const float *x, const float *y,
+			float *out_x, float *out_y, size_t n)
+{
+	matrix_kernels()->points_float(m->d, x, y, out_x, out_y, n);
+}
+
+void
+matrix_transform_points_double(const struct weston_matrix *m, const double *x, const double *y,
+			       double *out_x, double *out_y, size_t n)
+{
+	matrix_kernels()->points_double(m->d, x, y, out_x, out_y, n);
+}
+
+void
+matrix_transform_points_raw(const struct weston_matrix *m, const int32_t *x, const int32_t *y,
+			    float *out_x, float *out_y, size_t n)
+{
+	matrix_kernels()->points_raw(m->d, x, y, out_x, out_y, n);
+}
@@ -0,0 +1,77 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_MATRIX_SIMD_H
+#define CALTOOL_MATRIX_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+/*
+ * 4x4 kernels behind weston_matrix_multiply(), _transform() and _invert(),
+ * on the 16 column-major floats of a struct weston_matrix.
+ *
+ * The vector kernels are picked once at runtime from what the CPU
+ * supports, the scalar ones in matrix.c are the fallback. Products agree
+ * with the scalar kernels within MATRIX_SIMD_TOLERANCE relative to the
+ * largest element: the summation order differs and FMA skips a rounding.
+ * The vector inverse uses cofactors in float instead of LU in double, its
+ * error is within MATRIX_SIMD_TOLERANCE times the 1-norm condition number
+ * of the matrix, and it only rejects a zero or non-finite determinant.
+ */
+#define MATRIX_SIMD_TOLERANCE	1e-6
+
+struct matrix_kernels {
+	const char *name;
+	void (*multiply)(float *m, const float *n);	/* m <- n * m */
+	void (*transform)(const float *m, float *v);	/* v <- m * v */
+	int (*invert)(float *inverse, const float *m);
+	void (*points_float)(const float *m, const float *x, const float *y,
+			     float *out_x, float *out_y, size_t n);
+	void (*points_double)(const float *m, const double *x, const double *y,
+			      double *out_x, double *out_y, size_t n);
+	void (*points_raw)(const float *m, const int32_t *x, const int32_t *y,
+			   float *out_x, float *out_y, size_t n);
+};
+
+const struct matrix_kernels *matrix_kernels(void);
+const struct matrix_kernels *matrix_kernels_find(const char *);
+void matrix_kernels_use(const struct matrix_kernels *);
+
+/*
+ * Apply the 2D part of a matrix to n points held as separate x and y
+ * arrays, raw device units as int32. Points are taken as (x, y, 1, 1)
+ * and not divided by w, which is weston_matrix_transform() for both the
+ * calibration matrices of finish_calibration() (offset in d[8], d[9]) and
+ * weston 2D transforms (offset in d[12], d[13]). Output may alias input.
+ */
+void matrix_transform_points(const struct weston_matrix *, const float *, const float *,
+			     float *, float *, size_t);
+void matrix_transform_points_double(const struct weston_matrix *, const double *, const double *,
+				    double *, double *, size_t);
+void matrix_transform_points_raw(const struct weston_matrix *, const int32_t *, const int32_t *,
+				 float *, float *, size_t);
+
+void matrix_multiply_scalar(float *, const float *);
+void matrix_transform_scalar(const float *, float *);
+int matrix_invert_scalar(float *, const float *);
+
+#endif /* CALTOOL_MATRIX_SIMD_H */
@@ -0,0 +1,204 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Vector 4x4 kernels, included by matrix_simd.c once per instruction set
+ * with KERNEL(name) giving the suffixed function names and the target
+ * selected by a GCC target pragma. No include guard on purpose.
+ */
+
+static void
+KERNEL(multiply)(float *m, const float *n)
+{
+	v4sf c[4], r[4];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		c[i] = v4sf_load(n + i * 4);
+
+	// column i of n * m is n's columns weighted by column i of m
+	for (i = 0; i < 4; i++)
+		r[i] = c[0] * m[i * 4] + c[1] * m[i * 4 + 1] +
+		       c[2] * m[i * 4 + 2] + c[3] * m[i * 4 + 3];
+
+	for (i = 0; i < 4; i++)
+		v4sf_store(m + i * 4, r[i]);
+}
+
+static void
+KERNEL(transform)(const float *m, float *v)
+{
+	v4sf t;
+
+	t = v4sf_load(m) * v[0] + v4sf_load(m + 4) * v[1] +
+	    v4sf_load(m + 8) * v[2] + v4sf_load(m + 12) * v[3];
+	v4sf_store(v, t);
+}
+
+/*
+ * Inverse from the 2x2 sub-determinants of the first and last two
+ * columns. Each output vector is a row of the inverse, so the result is
+ * transposed back into columns at the end.
+ */
+static int
+KERNEL(invert)(float *inverse, const float *m)
+{
+	const v4si lo = { 0, 0, 0, 1 }, lo_pair = { 1, 2, 3, 2 };
+	const v4si hi = { 1, 2, 1, 2 }, hi_pair = { 3, 3, 3, 3 };
+	const v4si p1 = { 5, 5, 4, 3 }, p2 = { 4, 2, 2, 1 }, p3 = { 3, 1, 0, 0 };
+	const v4si e1 = { 1, 0, 0, 0 }, e2 = { 2, 2, 1, 1 }, e3 = { 3, 3, 3, 2 };
+	const v4sf even = { 1, -1, 1, -1 };
+	v4sf a0, a1, a2, a3, s_lo, s_hi, c_lo, c_hi, b0, b1, b2, b3, s1, s2, s3, c1, c2, c3;
+	v4sf t0, t1, t2, t3, d;
+	float det;
+
+	a0 = v4sf_load(m);
+	a1 = v4sf_load(m + 4);
+	a2 = v4sf_load(m + 8);
+	a3 = v4sf_load(m + 12);
+
+	// s: pairs (0,1) (0,2) (0,3) (1,2) | (1,3) (2,3) of columns 0 and 1
+	s_lo = __builtin_shuffle(a0, lo) * __builtin_shuffle(a1, lo_pair) -
+	       __builtin_shuffle(a1, lo) * __builtin_shuffle(a0, lo_pair);
+	s_hi = __builtin_shuffle(a0, hi) * __builtin_shuffle(a1, hi_pair) -
+	       __builtin_shuffle(a1, hi) * __builtin_shuffle(a0, hi_pair);
+	// c: the same pairs of columns 2 and 3
+	c_lo = __builtin_shuffle(a2, lo) * __builtin_shuffle(a3, lo_pair) -
+	       __builtin_shuffle(a3, lo) * __builtin_shuffle(a2, lo_pair);
+	c_hi = __builtin_shuffle(a2, hi) * __builtin_shuffle(a3, hi_pair) -
+	       __builtin_shuffle(a3, hi) * __builtin_shuffle(a2, hi_pair);
+
+	s1 = __builtin_shuffle(s_lo, s_hi, p1);
+	s2 = __builtin_shuffle(s_lo, s_hi, p2);
+	s3 = __builtin_shuffle(s_lo, s_hi, p3);
+	c1 = __builtin_shuffle(c_lo, c_hi, p1);
+	c2 = __builtin_shuffle(c_lo, c_hi, p2);
+	c3 = __builtin_shuffle(c_lo, c_hi, p3);
+
+	// adjugate rows, signs applied below
+	b0 = __builtin_shuffle(a1, e1) * c1 - __builtin_shuffle(a1, e2) * c2 +
+	     __builtin_shuffle(a1, e3) * c3;
+	b1 = __builtin_shuffle(a0, e1) * c1 - __builtin_shuffle(a0, e2) * c2 +
+	     __builtin_shuffle(a0, e3) * c3;
+	b2 = __builtin_shuffle(a3, e1) * s1 - __builtin_shuffle(a3, e2) * s2 +
+	     __builtin_shuffle(a3, e3) * s3;
+	b3 = __builtin_shuffle(a2, e1) * s1 - __builtin_shuffle(a2, e2) * s2 +
+	     __builtin_shuffle(a2, e3) * s3;
+
+	d = a0 * b0;
+	det = d[0] - d[1] + d[2] - d[3];
+	if (det == 0 || !isfinite(1 / det))
+		return -1;
+
+	b0 *= even / det;
+	b1 *= -even / det;
+	b2 *= even / det;
+	b3 *= -even / det;
+
+	t0 = __builtin_shuffle(b0, b1, (v4si){ 0, 4, 1, 5 });
+	t1 = __builtin_shuffle(b0, b1, (v4si){ 2, 6, 3, 7 });
+	t2 = __builtin_shuffle(b2, b3, (v4si){ 0, 4, 1, 5 });
+	t3 = __builtin_shuffle(b2, b3, (v4si){ 2, 6, 3, 7 });
+	v4sf_store(inverse, __builtin_shuffle(t0, t2, (v4si){ 0, 1, 4, 5 }));
+	v4sf_store(inverse + 4, __builtin_shuffle(t0, t2, (v4si){ 2, 3, 6, 7 }));
+	v4sf_store(inverse + 8, __builtin_shuffle(t1, t3, (v4si){ 0, 1, 4, 5 }));
+	v4sf_store(inverse + 12, __builtin_shuffle(t1, t3, (v4si){ 2, 3, 6, 7 }));
+
+	return 0;
+}
+
+/*
+ * Batch transforms of points in separate x and y arrays, eight at a time
+ * with the remainder done one by one. Output may alias the input.
+ */
+static void
+KERNEL(points_float)(const float *m, const float *x, const float *y,
+		     float *out_x, float *out_y, size_t n)
+{
+	const float a = m[0], b = m[4], c = m[8] + m[12];
+	const float d = m[1], e = m[5], f = m[9] + m[13];
+	v8sf vx, vy, rx, ry;
+	float tx;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		v8sf_load(&vx, x + i);
+		v8sf_load(&vy, y + i);
+		rx = vx * a + vy * b + c;
+		ry = vx * d + vy * e + f;
+		v8sf_store(out_x + i, &rx);
+		v8sf_store(out_y + i, &ry);
+	}
+	for (; i < n; i++) {
+		tx = x[i] * a + y[i] * b + c;
+		out_y[i] = x[i] * d + y[i] * e + f;
+		out_x[i] = tx;
+	}
+}
+
+static void
+KERNEL(points_double)(const float *m, const double *x, const double *y,
+		      double *out_x, double *out_y, size_t n)
+{
+	const double a = m[0], b = m[4], c = (double)m[8] + m[12];
+	const double d = m[1], e = m[5], f = (double)m[9] + m[13];
+	v4df vx, vy, rx, ry;
+	double tx;
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		v4df_load(&vx, x + i);
+		v4df_load(&vy, y + i);
+		rx = vx * a + vy * b + c;
+		ry = vx * d + vy * e + f;
+		v4df_store(out_x + i, &rx);
+		v4df_store(out_y + i, &ry);
+	}
+	for (; i < n; i++) {
+		tx = x[i] * a + y[i] * b + c;
+		out_y[i] = x[i] * d + y[i] * e + f;
+		out_x[i] = tx;
+	}
+}
+
+static void
+KERNEL(points_raw)(const float *m, const int32_t *x, const int32_t *y,
+		   float *out_x, float *out_y, size_t n)
+{
+	const float a = m[0], b = m[4], c = m[8] + m[12];
+	const float d = m[1], e = m[5], f = m[9] + m[13];
+	v8si ix, iy;
+	v8sf vx, vy, rx, ry;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		v8si_load(&ix, x + i);
+		v8si_load(&iy, y + i);
+		vx = __builtin_convertvector(ix, v8sf);
+		vy = __builtin_convertvector(iy, v8sf);
+		rx = vx * a + vy * b + c;
+		ry = vx * d + vy * e + f;
+		v8sf_store(out_x + i, &rx);
+		v8sf_store(out_y + i, &ry);
+	}
+	for (; i < n; i++) {
+		out_x[i] = x[i] * a + y[i] * b + c;
+		out_y[i] = x[i] * d + y[i] * e + f;
+	}
+}
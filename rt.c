@@ -0,0 +1,116 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+#include "stats.h"
+
+/*
+ * Run the calling thread, which handles the input events, with SCHED_FIFO
+ * and lock all current and future pages, so a busy boot can neither
+ * preempt touch dispatch nor make it wait for page faults.
+ */
+int
+rt_enable(FILE *fp, int priority)
+{
+	struct sched_param param;
+	int rc = 0;
+
+	if (priority < sched_get_priority_min(SCHED_FIFO))
+		priority = sched_get_priority_min(SCHED_FIFO);
+	if (priority > sched_get_priority_max(SCHED_FIFO))
+		priority = sched_get_priority_max(SCHED_FIFO);
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+		fprintf(fp, "SCHED_FIFO priority %d failed (%s)\n", priority, strerror(errno));
+		rc = -1;
+	} else {
+		fprintf(fp, "Running with SCHED_FIFO priority %d\n", priority);
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		fprintf(fp, "mlockall failed (%s)\n", strerror(errno));
+		rc = -1;
+	}
+
+	rt_prefault_stack();
+	return rc;
+}
+
+/*
+ * Touch the stack once, with MCL_FUTURE the pages then stay resident.
+ * The stores go through the volatile array, so the compiler keeps them.
+ */
+void __attribute__((noinline))
+rt_prefault_stack(void)
+{
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+	long page = sysconf(_SC_PAGESIZE);
+	long i;
+
+	if (page <= 0)
+		page = 4096;
+	for (i = 0; i < RT_STACK_PREFAULT; i += page)
+		stack[i] = 0;
+	(void)stack[0];
+}
+
+/*
+ * Sleep on absolute deadlines and record how late each wakeup is, which
+ * is the scheduling latency an input event sees on top of the kernel.
+ */
+void
+rt_measure_latency(FILE *fp)
+{
+	struct histogram latency;
+	struct timespec next, now;
+	uint64_t late;
+	int i;
+
+	histogram_init(&latency, "sched");
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	for (i = 0; i < RT_LATENCY_LOOPS; i++) {
+		next.tv_nsec += RT_LATENCY_INTERVAL_USEC * 1000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		late = (now.tv_sec - next.tv_sec) * 1000000LL +
+		       (now.tv_nsec - next.tv_nsec) / 1000;
+		histogram_add(&latency, late);
+	}
+
+	fprintf(fp, "Scheduling latency:\n");
+	histogram_print(fp, &latency);
+}
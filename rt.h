@@ -0,0 +1,36 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_RT_H
+#define CALTOOL_RT_H
+
+#include <stdio.h>
+
+/* Stack touched up front, deeper than the sample loop ever gets */
+#define RT_STACK_PREFAULT	(256 * 1024)
+
+/* Wakeups used to measure the scheduling latency */
+#define RT_LATENCY_LOOPS	1000
+#define RT_LATENCY_INTERVAL_USEC	1000
+
+int rt_enable(FILE *, int);
+void rt_prefault_stack(void);
+void rt_measure_latency(FILE *);
+
+#endif /* CALTOOL_RT_H */
@@ -0,0 +1,407 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stddef.h>
+
+#include "solver.h"
+
+static double
+norm1_3x3(const double *m)
+{
+	double norm = 0, sum;
+	int c;
+
+	// largest column sum, m is row major
+	for (c = 0; c < 3; c++) {
+		sum = fabs(m[c]) + fabs(m[3 + c]) + fabs(m[6 + c]);
+		if (sum > norm)
+			norm = sum;
+	}
+	return norm;
+}
+
+/*
+ * 1-norm condition number of the rows (x, y, 1) through the adjugate,
+ * det is its determinant.
+ */
+static double
+condition(const double *x, const double *y, double det)
+{
+	const double m[9] = {
+		x[0], y[0], 1,
+		x[1], y[1], 1,
+		x[2], y[2], 1
+	};
+	const double adj[9] = {
+		y[1] - y[2], y[2] - y[0], y[0] - y[1],
+		x[2] - x[1], x[0] - x[2], x[1] - x[0],
+		x[1] * y[2] - x[2] * y[1], x[2] * y[0] - x[0] * y[2], x[0] * y[1] - x[1] * y[0]
+	};
+
+	return norm1_3x3(m) * norm1_3x3(adj) / fabs(det);
+}
+
+/*
+ * Affine map taking the points (x, y) to (u, v), by Cramer's rule on the
+ * edge vectors from the first point. The offsets come from the centroids,
+ * which keeps them exact for points far from the origin.
+ *
+ * Returns -1 for (nearly) collinear points, the fit is then left unset
+ * except for det and cond.
+ */
+int
+solve_affine3(struct affine_fit *fit, const double *x, const double *y,
+	      const double *u, const double *v)
+{
+	double x2 = x[1] - x[0], y2 = y[1] - y[0];
+	double x3 = x[2] - x[0], y3 = y[2] - y[0];
+	double u2 = u[1] - u[0], u3 = u[2] - u[0];
+	double v2 = v[1] - v[0], v3 = v[2] - v[0];
+	double cx, cy, edge, det;
+	double centered_x[3], centered_y[3];
+	int i;
+
+	det = x2 * y3 - x3 * y2;
+	fit->det = det;
+
+	cx = (x[0] + x[1] + x[2]) / 3;
+	cy = (y[0] + y[1] + y[2]) / 3;
+	for (i = 0; i < 3; i++) {
+		centered_x[i] = x[i] - cx;
+		centered_y[i] = y[i] - cy;
+	}
+	fit->cond = det != 0 ? condition(centered_x, centered_y, det) : INFINITY;
+
+	edge = fmax(x2 * x2 + y2 * y2, x3 * x3 + y3 * y3);
+	if (det == 0 || fabs(det) <= SOLVER_DEGENERATE * edge)
+		return -1;
+
+	fit->coef[0] = (u2 * y3 - u3 * y2) / det;
+	fit->coef[1] = (x2 * u3 - x3 * u2) / det;
+	fit->coef[3] = (v2 * y3 - v3 * y2) / det;
+	fit->coef[4] = (x2 * v3 - x3 * v2) / det;
+
+	fit->coef[2] = (u[0] + u[1] + u[2]) / 3 - fit->coef[0] * cx - fit->coef[1] * cy;
+	fit->coef[5] = (v[0] + v[1] + v[2]) / 3 - fit->coef[3] * cx - fit->coef[4] * cy;
+
+	return 0;
+}
+
+/*
+ * Weighted least squares affine map taking n >= 3 points (x, y) to (u, v),
+ * w NULL weighs all points 1. Around the weighted centroid the normal
+ * equations of (x, y, 1) fall apart into a 2x2 system for the linear part
+ * and the means for the offsets, solved in closed form from sums over the
+ * points. No allocation, O(n).
+ *
+ * cond is the 2-norm condition number of the centered rows (x, y, 1).
+ * Returns -1 if the points are (nearly) on a line.
+ */
+int
+solve_affine_weighted(struct affine_fit *fit, const double *x, const double *y,
+		      const double *u, const double *v, const double *w, int n)
+{
+	double cx = 0, cy = 0, cu = 0, cv = 0, sw = 0;
+	double sxx = 0, sxy = 0, syy = 0, sxu = 0, syu = 0, sxv = 0, syv = 0;
+	double dx, dy, du, dv, wi, det, trace, root, hi, lo;
+	int i;
+
+	if (n < 3)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		wi = w ? w[i] : 1;
+		cx += wi * x[i];
+		cy += wi * y[i];
+		cu += wi * u[i];
+		cv += wi * v[i];
+		sw += wi;
+	}
+	if (sw <= 0)
+		return -1;
+	cx /= sw;
+	cy /= sw;
+	cu /= sw;
+	cv /= sw;
+
+	for (i = 0; i < n; i++) {
+		wi = w ? w[i] : 1;
+		dx = x[i] - cx;
+		dy = y[i] - cy;
+		du = u[i] - cu;
+		dv = v[i] - cv;
+		sxx += wi * dx * dx;
+		sxy += wi * dx * dy;
+		syy += wi * dy * dy;
+		sxu += wi * dx * du;
+		syu += wi * dy * du;
+		sxv += wi * dx * dv;
+		syv += wi * dy * dv;
+	}
+
+	det = sxx * syy - sxy * sxy;
+	fit->det = det;
+
+	// eigenvalues of the 2x2 normal matrix, the constant column adds the weights
+	trace = sxx + syy;
+	root = sqrt((sxx - syy) * (sxx - syy) + 4 * sxy * sxy);
+	hi = fmax((trace + root) / 2, sw);
+	lo = fmin((trace - root) / 2, sw);
+	fit->cond = lo > 0 ? sqrt(hi / lo) : INFINITY;
+
+	if (det <= SOLVER_DEGENERATE * trace * trace)
+		return -1;
+
+	fit->coef[0] = (syy * sxu - sxy * syu) / det;
+	fit->coef[1] = (sxx * syu - sxy * sxu) / det;
+	fit->coef[3] = (syy * sxv - sxy * syv) / det;
+	fit->coef[4] = (sxx * syv - sxy * sxv) / det;
+
+	fit->coef[2] = cu - fit->coef[0] * cx - fit->coef[1] * cy;
+	fit->coef[5] = cv - fit->coef[3] * cx - fit->coef[4] * cy;
+
+	return 0;
+}
+
+int
+solve_affine(struct affine_fit *fit, const double *x, const double *y,
+	     const double *u, const double *v, int n)
+{
+	return solve_affine_weighted(fit, x, y, u, v, NULL, n);
+}
+
+/*
+ * Fitted minus wanted position of each point into du and dv, either may
+ * be NULL. Returns the RMS of the residual lengths.
+ */
+double
+affine_fit_residuals(const struct affine_fit *fit, const double *x, const double *y,
+		     const double *u, const double *v, int n, double *du, double *dv)
+{
+	const double *c = fit->coef;
+	double ru, rv, sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ru = c[0] * x[i] + c[1] * y[i] + c[2] - u[i];
+		rv = c[3] * x[i] + c[4] * y[i] + c[5] - v[i];
+		if (du)
+			du[i] = ru;
+		if (dv)
+			dv[i] = rv;
+		sum += ru * ru + rv * rv;
+	}
+	return n > 0 ? sqrt(sum / n) : 0;
+}
+
+static double
+residual_length(const double *c, double x, double y, double u, double v)
+{
+	return hypot(c[0] * x + c[1] * y + c[2] - u, c[3] * x + c[4] * y + c[5] - v);
+}
+
+/*
+ * Whether a single bad point among the n points (x, y) can be told apart
+ * from any other bad point. One bad point p leaves least squares residuals
+ * along column p of M = I - H, with H the hat matrix of the rows (x, y, 1).
+ * M is symmetric and idempotent, so the cosine between columns p and q is
+ * M[p][q] / sqrt(M[p][p] M[q][q]). Two nearly parallel columns look the
+ * same, e.g. opposite corners when the center is the midpoint of both
+ * diagonals, and a small M[p][p] means the fit follows point p wherever
+ * it is. The answer only depends on the layout, an affine map of the
+ * points leaves H as it is.
+ */
+int
+robust_identifiable(const double *x, const double *y, int n)
+{
+	double cx = 0, cy = 0, sxx = 0, sxy = 0, syy = 0, det;
+	double dx[ROBUST_MAX_POINTS], dy[ROBUST_MAX_POINTS], m[ROBUST_MAX_POINTS];
+	double h;
+	int i, j;
+
+	if (n < ROBUST_MIN_POINTS || n > ROBUST_MAX_POINTS)
+		return 0;
+
+	for (i = 0; i < n; i++) {
+		cx += x[i];
+		cy += y[i];
+	}
+	cx /= n;
+	cy /= n;
+	for (i = 0; i < n; i++) {
+		dx[i] = x[i] - cx;
+		dy[i] = y[i] - cy;
+		sxx += dx[i] * dx[i];
+		sxy += dx[i] * dy[i];
+		syy += dy[i] * dy[i];
+	}
+	det = sxx * syy - sxy * sxy;
+	if (det <= SOLVER_DEGENERATE * (sxx + syy) * (sxx + syy))
+		return 0;
+
+	// H[i][j] = 1/n + (dx_i, dy_i) S^-1 (dx_j, dy_j)^T around the centroid
+	for (i = 0; i < n; i++) {
+		h = 1.0 / n + (dx[i] * (syy * dx[i] - sxy * dy[i]) +
+			       dy[i] * (sxx * dy[i] - sxy * dx[i])) / det;
+		m[i] = 1 - h;
+		if (m[i] < ROBUST_MIN_FREEDOM)
+			return 0;
+	}
+	for (i = 0; i < n - 1; i++) {
+		for (j = i + 1; j < n; j++) {
+			h = 1.0 / n + (dx[i] * (syy * dx[j] - sxy * dy[j]) +
+				       dy[i] * (sxx * dy[j] - sxy * dx[j])) / det;
+			if (fabs(h) >= ROBUST_AMBIGUOUS * sqrt(m[i] * m[j]))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Outlier resistant fit, for n <= ROBUST_MAX_POINTS. Every 3 point subset
+ * is fitted exactly and scored by the sum of squared residuals clipped at
+ * threshold (MSAC), so the result does not depend on a random sequence.
+ * The best model is refined by iteratively reweighted least squares with
+ * Huber weights, then points farther than threshold from it are flagged
+ * in outlier[].
+ *
+ * Only layouts that pass robust_identifiable() can tell outliers apart,
+ * the 9 and 25 target ones but not the 5 target one for example. For any
+ * other it is a plain least squares fit that flags nothing, rather than
+ * blaming a good point for a bad one. Returns the number of outliers, or
+ * -1 if no model could be fitted.
+ */
+int
+solve_affine_robust(struct affine_fit *fit, const double *x, const double *y,
+		    const double *u, const double *v, int n, double threshold,
+		    unsigned char *outlier)
+{
+	double sx[3], sy[3], su[3], sv[3], w[ROBUST_MAX_POINTS];
+	double cost, best_cost = INFINITY, r, change;
+	struct affine_fit subset, next;
+	int i, j, k, p, pick[3], iteration, count = 0;
+
+	for (i = 0; i < n; i++)
+		outlier[i] = 0;
+
+	if (!robust_identifiable(x, y, n))
+		return solve_affine(fit, x, y, u, v, n) < 0 ? -1 : 0;
+
+	for (i = 0; i < n - 2; i++) {
+		for (j = i + 1; j < n - 1; j++) {
+			for (k = j + 1; k < n; k++) {
+				pick[0] = i;
+				pick[1] = j;
+				pick[2] = k;
+				for (p = 0; p < 3; p++) {
+					sx[p] = x[pick[p]];
+					sy[p] = y[pick[p]];
+					su[p] = u[pick[p]];
+					sv[p] = v[pick[p]];
+				}
+				if (solve_affine3(&subset, sx, sy, su, sv) < 0)
+					continue;
+
+				cost = 0;
+				for (p = 0; p < n && cost < best_cost; p++) {
+					r = residual_length(subset.coef, x[p], y[p], u[p], v[p]);
+					cost += r < threshold ? r * r : threshold * threshold;
+				}
+				if (cost < best_cost) {
+					best_cost = cost;
+					*fit = subset;
+				}
+			}
+		}
+	}
+	if (best_cost == INFINITY)
+		return -1;
+
+	for (iteration = 0; iteration < ROBUST_ITERATIONS; iteration++) {
+		for (p = 0; p < n; p++) {
+			r = residual_length(fit->coef, x[p], y[p], u[p], v[p]);
+			w[p] = r <= threshold ? 1 : threshold / r;
+		}
+		if (solve_affine_weighted(&next, x, y, u, v, w, n) < 0)
+			break;
+
+		change = 0;
+		for (p = 0; p < 6; p++)
+			change = fmax(change, fabs(next.coef[p] - fit->coef[p]));
+		*fit = next;
+		if (change < 1e-12)
+			break;
+	}
+
+	for (p = 0; p < n; p++) {
+		if (residual_length(fit->coef, x[p], y[p], u[p], v[p]) > threshold) {
+			outlier[p] = 1;
+			count++;
+		}
+	}
+	return count;
+}
+
+void
+affine_rls_init(struct affine_rls *rls, double forget)
+{
+	int i;
+
+	for (i = 0; i < 6; i++)
+		rls->coef[i] = i == 0 || i == 4;
+	for (i = 0; i < 9; i++)
+		rls->p[i] = i % 4 == 0 ? RLS_PRIOR : 0;
+	rls->forget = forget;
+	rls->n = 0;
+}
+
+/*
+ * Recursive least squares update with the point (x, y) taken to (u, v),
+ * constant time and memory however many points came before.
+ */
+void
+affine_rls_add(struct affine_rls *rls, double x, double y, double u, double v)
+{
+	const double phi[3] = { x, y, 1 };
+	double *c = rls->coef, *p = rls->p;
+	double pphi[3], gain[3], denom, eu, ev;
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+		pphi[i] = p[i * 3] * phi[0] + p[i * 3 + 1] * phi[1] + p[i * 3 + 2] * phi[2];
+	denom = rls->forget + phi[0] * pphi[0] + phi[1] * pphi[1] + phi[2] * pphi[2];
+	for (i = 0; i < 3; i++)
+		gain[i] = pphi[i] / denom;
+
+	eu = u - (c[0] * x + c[1] * y + c[2]);
+	ev = v - (c[3] * x + c[4] * y + c[5]);
+	for (i = 0; i < 3; i++) {
+		c[i] += gain[i] * eu;
+		c[3 + i] += gain[i] * ev;
+	}
+
+	// P = (P - k phi^T P) / forget, p is symmetric so phi^T P = pphi^T
+	for (i = 0; i < 3; i++)
+		for (j = i; j < 3; j++)
+			p[i * 3 + j] = p[j * 3 + i] = (p[i * 3 + j] - gain[i] * pphi[j]) / rls->forget;
+
+	rls->n++;
+}
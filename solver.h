@@ -0,0 +1,82 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_SOLVER_H
+#define CALTOOL_SOLVER_H
+
+/*
+ * Three points closer to a line than this, as the sine of the angle
+ * between two edges scaled by their length ratio, are rejected.
+ */
+#define SOLVER_DEGENERATE	1e-6
+
+/*
+ * Robust fits need enough points for a majority of inliers, and try all
+ * 3 point subsets, C(25, 3) = 2300 at most. With 5 points no layout keeps
+ * the residual patterns of single bad points below ROBUST_AMBIGUOUS, see
+ * robust_identifiable(), so 6 is the least that can work.
+ */
+#define ROBUST_MIN_POINTS	6
+#define ROBUST_MAX_POINTS	25
+#define ROBUST_ITERATIONS	10
+#define ROBUST_AMBIGUOUS	0.8
+#define ROBUST_MIN_FREEDOM	0.1
+
+/*
+ * Recursive least squares starts from the identity with this variance on
+ * every coefficient, large enough that three points decide the estimate.
+ * RLS_FORGET 1 weighs all samples the same, below 1 old samples fade out.
+ */
+#define RLS_PRIOR	1e6
+#define RLS_FORGET	1.0
+
+/* x' = coef[0] x + coef[1] y + coef[2], y' = coef[3] x + coef[4] y + coef[5] */
+struct affine_fit {
+	double coef[6];
+	double det;		/* of the (normal) point matrix, centered */
+	double cond;		/* condition number of the centered point matrix */
+};
+
+/*
+ * Both axes regress on the same (x, y, 1), so with equal weights they share
+ * one 3x3 covariance, kept once in p (row major).
+ */
+struct affine_rls {
+	double coef[6];
+	double p[9];
+	double forget;
+	unsigned long n;
+};
+
+int solve_affine3(struct affine_fit *, const double *, const double *,
+		  const double *, const double *);
+int solve_affine(struct affine_fit *, const double *, const double *,
+		 const double *, const double *, int);
+int solve_affine_weighted(struct affine_fit *, const double *, const double *,
+			  const double *, const double *, const double *, int);
+int robust_identifiable(const double *, const double *, int);
+int solve_affine_robust(struct affine_fit *, const double *, const double *,
+			const double *, const double *, int, double, unsigned char *);
+double affine_fit_residuals(const struct affine_fit *, const double *, const double *,
+			    const double *, const double *, int, double *, double *);
+
+void affine_rls_init(struct affine_rls *, double);
+void affine_rls_add(struct affine_rls *, double, double, double, double);
+
+#endif /* CALTOOL_SOLVER_H */
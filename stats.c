@@ -0,0 +1,177 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const char *latency_stage_names[LATENCY_STAGES] = {
+	"dispatch",
+	"process",
+	"draw",
+	"present"
+};
+
+uint64_t
+monotonic_usec(void)
+{
+	struct timespec ts;
+
+	// libinput event times use the same clock
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+running_stats_reset(struct running_stats *rs)
+{
+	rs->n = 0;
+	rs->mean = 0;
+	rs->m2 = 0;
+}
+
+void
+running_stats_add(struct running_stats *rs, double value)
+{
+	double delta = value - rs->mean;
+
+	rs->n++;
+	rs->mean += delta / rs->n;
+	rs->m2 += delta * (value - rs->mean);
+}
+
+/* Population variance of the values added so far */
+double
+running_stats_variance(const struct running_stats *rs)
+{
+	if (rs->n < 2)
+		return 0;
+
+	return rs->m2 / rs->n;
+}
+
+void
+histogram_init(struct histogram *h, const char *name)
+{
+	memset(h, 0, sizeof(*h));
+	h->name = name;
+	h->min = UINT64_MAX;
+}
+
+void
+histogram_add(struct histogram *h, uint64_t usec)
+{
+	uint64_t bucket = usec / HISTOGRAM_BUCKET_USEC;
+
+	if (bucket < HISTOGRAM_BUCKETS)
+		h->buckets[bucket]++;
+	else
+		h->overflow++;
+
+	if (usec < h->min)
+		h->min = usec;
+	if (usec > h->max)
+		h->max = usec;
+	h->sum += usec;
+	h->count++;
+}
+
+/*
+ * Returns the upper bound of the bucket holding the p-th percentile
+ * (0 < p <= 1), clamped to the largest value seen.
+ */
+uint64_t
+histogram_percentile(const struct histogram *h, double p)
+{
+	unsigned long rank, seen = 0;
+	uint64_t value;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+
+	rank = p * h->count + 0.5;
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			value = (uint64_t)(i + 1) * HISTOGRAM_BUCKET_USEC;
+			return value < h->max ? value : h->max;
+		}
+	}
+
+	// rank falls into the overflow bucket
+	return h->max;
+}
+
+void
+histogram_print(FILE *fp, const struct histogram *h)
+{
+	if (h->count == 0) {
+		fprintf(fp, "%-10s n=0\n", h->name);
+		return;
+	}
+
+	fprintf(fp, "%-10s n=%lu min=%llu avg=%llu p50=%llu p95=%llu p99=%llu max=%llu usec (overflow %lu)\n",
+		h->name, h->count,
+		(unsigned long long)h->min,
+		(unsigned long long)(h->sum / h->count),
+		(unsigned long long)histogram_percentile(h, 0.50),
+		(unsigned long long)histogram_percentile(h, 0.95),
+		(unsigned long long)histogram_percentile(h, 0.99),
+		(unsigned long long)h->max,
+		h->overflow);
+}
+
+void
+latency_stats_init(struct latency_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < LATENCY_STAGES; i++)
+		histogram_init(&stats->stage[i], latency_stage_names[i]);
+}
+
+/* All stages are measured from the kernel timestamp of the event */
+void
+latency_stats_add(struct latency_stats *stats, const struct sample_times *t)
+{
+	const uint64_t done[LATENCY_STAGES] = {
+		t->dispatch, t->processed, t->drawn, t->presented
+	};
+	int i;
+
+	for (i = 0; i < LATENCY_STAGES; i++) {
+		if (done[i] >= t->event)
+			histogram_add(&stats->stage[i], done[i] - t->event);
+	}
+}
+
+void
+latency_stats_print(FILE *fp, const struct latency_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < LATENCY_STAGES; i++)
+		histogram_print(fp, &stats->stage[i]);
+}
@@ -0,0 +1,81 @@
+/*
+	caltool - Touch screen calibration tool for XCSoar Glide Computer - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALTOOL_STATS_H
+#define CALTOOL_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Fixed bucket histogram, 250us per bucket up to 100ms */
+#define HISTOGRAM_BUCKET_USEC	250
+#define HISTOGRAM_BUCKETS	400
+
+struct histogram {
+	const char *name;
+	unsigned long count;
+	unsigned long overflow;
+	uint64_t min, max, sum;
+	unsigned long buckets[HISTOGRAM_BUCKETS];
+};
+
+/* Timestamps (CLOCK_MONOTONIC, usec) of one sample on its way to the screen */
+struct sample_times {
+	uint64_t event;		/* kernel timestamp of the touch event */
+	uint64_t dispatch;	/* event taken from the libinput queue */
+	uint64_t processed;	/* sample stored in the calibrator */
+	uint64_t drawn;		/* feedback drawn to the framebuffer */
+	uint64_t presented;	/* next vsync after drawing, if supported */
+};
+
+enum latency_stage {
+	LATENCY_DISPATCH,
+	LATENCY_PROCESS,
+	LATENCY_DRAW,
+	LATENCY_PRESENT,
+	LATENCY_STAGES
+};
+
+struct latency_stats {
+	struct histogram stage[LATENCY_STAGES];
+};
+
+/* Streaming mean and variance (Welford), constant memory */
+struct running_stats {
+	unsigned long n;
+	double mean;
+	double m2;
+};
+
+uint64_t monotonic_usec(void);
+
+void running_stats_reset(struct running_stats *);
+void running_stats_add(struct running_stats *, double);
+double running_stats_variance(const struct running_stats *);
+
+void histogram_init(struct histogram *, const char *);
+void histogram_add(struct histogram *, uint64_t);
+uint64_t histogram_percentile(const struct histogram *, double);
+void histogram_print(FILE *, const struct histogram *);
+
+void latency_stats_init(struct latency_stats *);
+void latency_stats_add(struct latency_stats *, const struct sample_times *);
+void latency_stats_print(FILE *, const struct latency_stats *);
+
+#endif /* CALTOOL_STATS_H */
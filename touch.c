@@ -8,15 +8,20 @@
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <time.h>
+#include <math.h>
 
 #include <libinput.h>
 #include <libudev.h>
 #include <poll.h>
 #include <signal.h>
 #include <sys/signalfd.h>
+#include <linux/input.h>
 
 #include "touch.h"
 #include "matrix.h"
+#include "affine.h"
+#include "solver.h"
+#include "stats.h"
 
 
 extern int events;
@@ -27,6 +32,9 @@ extern int xres;
 extern int yres;
 extern int verbose;
 extern FILE *fp_log;
+extern double dwell_variance;
+extern char device_name[128];
+extern struct sample_filter_config sample_filter_default;
 
 
 /*
@@ -66,194 +74,1115 @@ extern FILE *fp_log;
 * For the calibration the desired values x, y are the same values at which
 * we've drawn at.
 *
+* M^-1 has a closed form for three points, see solve_affine3(). With more
+* targets M is not square and the constants are the least squares
+* solution, see solve_affine().
+*
 */
 
-void
+/* Raw device units to libinput's normalized [0, 1) device coordinates */
+static double
+normalize_raw(const struct touch_axis *axis, double raw)
+{
+	return (raw - axis->minimum) / ((double)axis->maximum - axis->minimum + 1);
+}
+
+#ifdef CALTOOL_FIXED_POINT
+/*
+ * Replace the coefficients of fit by the integer solution, the same bit
+ * for bit on every board. The double fit before it has already rejected
+ * bad layouts and provides the diagnostics.
+ */
+static int
+fixed_calibration(struct affine_fit *fit, const double *x, const double *y,
+		  const double *u, const double *v, int n)
+{
+	fixed_t fx[MAX_TESTS], fy[MAX_TESTS], fu[MAX_TESTS], fv[MAX_TESTS];
+	struct affine_fixed a;
+	int i, ret;
+	
+	for (i = 0; i < n; i++) {
+		fx[i] = fixed_from_double(x[i]);
+		fy[i] = fixed_from_double(y[i]);
+		fu[i] = fixed_from_double(u[i]);
+		fv[i] = fixed_from_double(v[i]);
+	}
+	if (n == 3)
+		ret = solve_affine3_fixed(&a, fx, fy, fu, fv);
+	else
+		ret = solve_affine_fixed(&a, fx, fy, fu, fv, n);
+	if (ret < 0)
+		return -1;
+	
+	for (i = 0; i < 6; i++)
+		fit->coef[i] = fixed_to_double(a.m[i]);
+	return 0;
+}
+#endif
+
+int
 finish_calibration (struct calibrator *calibrator, struct weston_matrix *cal_matrix)
 {
-	struct weston_matrix m;
-	struct weston_matrix inverse;
-	struct weston_vector x_calib, y_calib;
-	int i;
+	double touched_x[MAX_TESTS], touched_y[MAX_TESTS];
+	double drawn_x[MAX_TESTS], drawn_y[MAX_TESTS];
+	double residual_x[MAX_TESTS], residual_y[MAX_TESTS];
+	int index[MAX_TESTS];
+	struct affine_fit fit;
+	struct affine cal;
+	struct tests *test;
+	float coef[6];
+	double rms = 0;
+	int i, n = 0, ret;
 	
 	/*
-	* x1 y1 1 0
-	* x2 y2 1 0
-	* x3 y3 1 0
-	* 0 0 0 1
+	* LIBINPUT_CALIBRATION_MATRIX works on normalized device coordinates,
+	* so the system is solved in those: raw samples scaled by the device
+	* range, drawn positions scaled by the screen size. The coefficients
+	* then apply as they are, whatever transform was active while sampling.
 	*/
+	for (i = 0; i < calibrator->num_tests; i++) {
+		// outliers that could not be retaken stay out
+		if (calibrator->tests[i].outlier)
+			continue;
+		touched_x[n] = normalize_raw(&calibrator->axis_x, calibrator->tests[i].raw_x);
+		touched_y[n] = normalize_raw(&calibrator->axis_y, calibrator->tests[i].raw_y);
+		drawn_x[n] = calibrator->tests[i].drawn_x / xres;
+		drawn_y[n] = calibrator->tests[i].drawn_y / yres;
+		index[n++] = i;
+	}
+	
+	// an interrupted session, or too many outliers left out
+	if (n < 3) {
+		fprintf(fp_log, "%s: only %d usable samples, no calibration\n",
+			calibrator->sysname, n);
+		return -1;
+	}
 	
-	// write touched coordinates in Matrix M
-	memset(&m, 0, sizeof(m));
-	for (i = 0; i < (int)ARRAY_LENGTH(test_ratios); i++) {
-		m.d[i] = calibrator->tests[i].clicked_x;
-		m.d[i + 4] = calibrator->tests[i].clicked_y;
-		m.d[i + 8] = 1;
+	// exact for three targets, least squares for more
+	if (n == 3)
+		ret = solve_affine3(&fit, touched_x, touched_y, drawn_x, drawn_y);
+	else
+		ret = solve_affine(&fit, touched_x, touched_y, drawn_x, drawn_y, n);
+	if (ret < 0) {
+		fprintf(fp_log, "%s: %d samples are collinear (det %g), no calibration\n",
+			calibrator->sysname, n, fit.det);
+		return -1;
 	}
-	m.d[15] = 1;
 	
-	// calculate M^-1
-	weston_matrix_invert(&inverse, &m);
+#ifdef CALTOOL_FIXED_POINT
+	if (fixed_calibration(&fit, touched_x, touched_y, drawn_x, drawn_y, n) < 0) {
+		fprintf(fp_log, "%s: fixed point calibration out of range !!\n",
+			calibrator->sysname);
+		return -1;
+	}
+	fprintf(fp_log, "Fixed point Q%d.%d\n", 32 - FIXED_FRAC_BITS, FIXED_FRAC_BITS);
+#endif
+	
+	fprintf (fp_log,"Calibration values: %f %f %f %f %f %f\n",
+		fit.coef[0], fit.coef[1], fit.coef[2],
+		fit.coef[3], fit.coef[4], fit.coef[5]);
+	
+	affine_fit_residuals(&fit, touched_x, touched_y, drawn_x, drawn_y, n,
+			     residual_x, residual_y);
+	for (i = 0; i < n; i++) {
+		test = &calibrator->tests[index[i]];
+		test->residual_x = residual_x[i] * xres;
+		test->residual_y = residual_y[i] * yres;
+		rms += test->residual_x * test->residual_x + test->residual_y * test->residual_y;
+		fprintf(fp_log, "%s Target %d at %.0f,%.0f: residual %f, %f px\n",
+			calibrator->sysname, index[i], test->drawn_x, test->drawn_y,
+			test->residual_x, test->residual_y);
+	}
+	fprintf(fp_log, "%s: %d targets, RMS error %f px, determinant %g, condition number %.1f\n",
+		calibrator->sysname, n, sqrt(rms / n), fit.det, fit.cond);
+	
+	// save calibration values in matrix
+	for (i = 0; i < 6; i++)
+		coef[i] = fit.coef[i];
+	affine_set(&cal, coef);
+	affine_to_matrix(cal_matrix, &cal);
+	
+	return 0;
+}
+
+/*
+ * Replace the affine calibration in cal_matrix, as finish_calibration()
+ * left it, by a homography if that takes enough off its error: panels
+ * mounted at a tilt show perspective an affine map cannot follow. Returns
+ * 1 if cal_matrix now holds the homography, 0 if it kept the affine map.
+ */
+int
+finish_projective(struct calibrator *calibrator, struct weston_matrix *cal_matrix)
+{
+	double touched_x[MAX_TESTS], touched_y[MAX_TESTS];
+	double drawn_x[MAX_TESTS], drawn_y[MAX_TESTS];
+	double residual_x[MAX_TESTS], residual_y[MAX_TESTS];
+	double affine_rms = 0, rms;
+	int index[MAX_TESTS];
+	struct homography model;
+	struct tests *test;
+	int i, n = 0;
 	
-	/*printf("Matrix M\n");
-	for (i = 0; i < (int)ARRAY_LENGTH(test_ratios)+1; i++) {
-		printf("%f \t%f \t%f \t%f\n", m.d[i], m.d[i+4], m.d[i+8], m.d[i+12]);
+	for (i = 0; i < calibrator->num_tests; i++) {
+		test = &calibrator->tests[i];
+		if (test->outlier)
+			continue;
+		touched_x[n] = normalize_raw(&calibrator->axis_x, test->raw_x);
+		touched_y[n] = normalize_raw(&calibrator->axis_y, test->raw_y);
+		drawn_x[n] = test->drawn_x / xres;
+		drawn_y[n] = test->drawn_y / yres;
+		affine_rms += test->residual_x * test->residual_x + test->residual_y * test->residual_y;
+		index[n++] = i;
 	}
+	if (n < PROJECTIVE_MIN_POINTS)
+		return 0;
+	affine_rms = sqrt(affine_rms / n);
 	
-	printf("Matrix M^1\n");
-	for (i = 0; i < (int)ARRAY_LENGTH(test_ratios); i++) {
-		printf("%f \t%f \t%f \t%f\n", inverse.d[i], inverse.d[i+4], inverse.d[i+8], inverse.d[i+12]);
-	}*/
+	if (solve_homography(&model, touched_x, touched_y, drawn_x, drawn_y, n) < 0) {
+		fprintf(fp_log, "%s: no projective fit, keeping affine\n", calibrator->sysname);
+		return 0;
+	}
 	
-	memset(&x_calib, 0, sizeof(x_calib));
-	memset(&y_calib, 0, sizeof(y_calib));
+	homography_residuals(&model, touched_x, touched_y, drawn_x, drawn_y, n,
+			     residual_x, residual_y);
+	rms = 0;
+	for (i = 0; i < n; i++) {
+		residual_x[i] *= xres;
+		residual_y[i] *= yres;
+		rms += residual_x[i] * residual_x[i] + residual_y[i] * residual_y[i];
+	}
+	rms = sqrt(rms / n);
+	
+	fprintf(fp_log, "%s: projective RMS error %f px, affine %f px\n",
+		calibrator->sysname, rms, affine_rms);
+	if (rms > PROJECTIVE_GAIN * affine_rms || affine_rms - rms < PROJECTIVE_MIN_PX)
+		return 0;
 	
-	for (i = 0; i < (int)ARRAY_LENGTH(test_ratios); i++) {
-		x_calib.f[i] = calibrator->tests[i].drawn_x;
-		y_calib.f[i] = calibrator->tests[i].drawn_y;
+	fprintf(fp_log, "Projective values: %f %f %f %f %f %f %f %f %f\n",
+		model.h[0], model.h[1], model.h[2], model.h[3], model.h[4],
+		model.h[5], model.h[6], model.h[7], model.h[8]);
+	for (i = 0; i < n; i++) {
+		calibrator->tests[index[i]].residual_x = residual_x[i];
+		calibrator->tests[index[i]].residual_y = residual_y[i];
 	}
+	homography_to_matrix(cal_matrix, &model);
+	return 1;
+}
 
-	/* Multiples into the vector */
-	weston_matrix_transform(&inverse, &x_calib);
-	weston_matrix_transform(&inverse, &y_calib);
-	fprintf (fp_log,"Calibration values: %f %f %f %f %f %f\n",
-		x_calib.f[0], x_calib.f[1], x_calib.f[2],
-		y_calib.f[0], y_calib.f[1], y_calib.f[2]);
+/*
+ * Fit the non-linear correction to what the calibration in
+ * cal_matrix leaves at the targets, and bake it into grid. Needs 9
+ * targets, see correction_fit().
+ */
+int
+finish_correction(struct calibrator *calibrator, const struct weston_matrix *cal_matrix,
+		  struct correction_grid *grid)
+{
+	double x[MAX_TESTS], y[MAX_TESTS], ex[MAX_TESTS], ey[MAX_TESTS];
+	double tx, ty, cx, cy, before = 0, after = 0;
+	struct correction_poly poly;
+	struct homography cal;
+	int i, n = 0;
 	
+	// affine or projective, whichever went to the cal file
+	homography_from_matrix(&cal, cal_matrix);
+	for (i = 0; i < calibrator->num_tests; i++) {
+		if (calibrator->tests[i].outlier)
+			continue;
+		tx = normalize_raw(&calibrator->axis_x, calibrator->tests[i].raw_x);
+		ty = normalize_raw(&calibrator->axis_y, calibrator->tests[i].raw_y);
+		homography_transform(&cal, &tx, &ty);
+		x[n] = tx;
+		y[n] = ty;
+		ex[n] = calibrator->tests[i].drawn_x / xres - tx;
+		ey[n] = calibrator->tests[i].drawn_y / yres - ty;
+		n++;
+	}
 	
-	// save calibration values in matrix	
-	cal_matrix->d[0] = x_calib.f[0];
-	cal_matrix->d[4] = x_calib.f[1];
-	cal_matrix->d[8] = (x_calib.f[2]/xres);
-	cal_matrix->d[12] = 0;
+	if (correction_fit(&poly, x, y, ex, ey, n) < 0) {
+		fprintf(fp_log, "%s: no correction grid from %d targets, needs 9\n",
+			calibrator->sysname, n);
+		return -1;
+	}
+	correction_bake(grid, &poly);
+	grid->base = cal.h[6] != 0 || cal.h[7] != 0 ? CORRECTION_PROJECTIVE : CORRECTION_AFFINE;
 	
-	cal_matrix->d[1] = y_calib.f[0];
-	cal_matrix->d[5] = y_calib.f[1];
-	cal_matrix->d[9] = (y_calib.f[2]/yres);
-	cal_matrix->d[13] = 0;
+	for (i = 0; i < n; i++) {
+		before += ex[i] * xres * ex[i] * xres + ey[i] * yres * ey[i] * yres;
+		cx = x[i];
+		cy = y[i];
+		correction_apply(grid, &cx, &cy);
+		cx = (x[i] + ex[i] - cx) * xres;
+		cy = (y[i] + ey[i] - cy) * yres;
+		after += cx * cx + cy * cy;
+	}
+	fprintf(fp_log, "%s: degree %d correction, RMS error %f px uncorrected, %f px corrected\n",
+		calibrator->sysname, poly.degree, sqrt(before / n), sqrt(after / n));
+	return 0;
+}
+
+/*
+ * Flag the targets whose sample is farther than threshold pixels from a
+ * robust fit of all samples, see solve_affine_robust(). The fit is done
+ * with the drawn positions in pixels, so the threshold applies as is.
+ * Returns the number of outliers.
+ */
+int
+find_outliers(struct calibrator *calibrator, double threshold)
+{
+	double touched_x[MAX_TESTS], touched_y[MAX_TESTS];
+	double drawn_x[MAX_TESTS], drawn_y[MAX_TESTS];
+	unsigned char outlier[MAX_TESTS];
+	int n = calibrator->num_tests;
+	struct affine_fit fit;
+	struct tests *test;
+	double r;
+	int i, count;
 	
-	cal_matrix->d[2] = 0;
-	cal_matrix->d[6] = 0;
-	cal_matrix->d[10] = 1;
-	cal_matrix->d[14] = 0;
+	for (i = 0; i < n; i++) {
+		touched_x[i] = normalize_raw(&calibrator->axis_x, calibrator->tests[i].raw_x);
+		touched_y[i] = normalize_raw(&calibrator->axis_y, calibrator->tests[i].raw_y);
+		drawn_x[i] = calibrator->tests[i].drawn_x;
+		drawn_y[i] = calibrator->tests[i].drawn_y;
+	}
 	
-	cal_matrix->d[15] = 1;
+	count = solve_affine_robust(&fit, touched_x, touched_y, drawn_x, drawn_y, n,
+				    threshold, outlier);
+	if (count < 0)
+		return 0;
 	
+	for (i = 0; i < n; i++) {
+		test = &calibrator->tests[i];
+		test->outlier = outlier[i];
+		if (!outlier[i])
+			continue;
+		r = hypot(fit.coef[0] * touched_x[i] + fit.coef[1] * touched_y[i] + fit.coef[2] - drawn_x[i],
+			  fit.coef[3] * touched_x[i] + fit.coef[4] * touched_y[i] + fit.coef[5] - drawn_y[i]);
+		fprintf(fp_log, "%s Target %d at %.0f,%.0f is an outlier, %f px off\n",
+			calibrator->sysname, i, test->drawn_x, test->drawn_y, r);
+	}
+	return count;
 }
 
+/*
+ * Display rotation applied after the calibration, in the normalized
+ * coordinates of the calibration matrix.
+ */
+static const float rotations[4][6] = {
+	{ 1, 0, 0,  0, 1, 0 },
+	{ 0, -1, 1,  1, 0, 0 },		// 90 deg
+	{ -1, 0, 1,  0, -1, 1 },	// 180 deg
+	{ 0, 1, 0,  -1, 0, 0 },		// 270 deg	// Still buggy !!!
+};
+
 void 
 rotate_calibration_matrix(struct weston_matrix *cal_matrix, int rotation)
 {
-	struct weston_matrix rot_matrix;
+	struct affine cal, rot;
+	
+	if (rotation <= 0 || rotation >= (int)ARRAY_LENGTH(rotations))
+		return;
+	
+	affine_from_matrix(&cal, cal_matrix);
+	affine_set(&rot, rotations[rotation]);
+	affine_multiply(&cal, &rot);
+	affine_to_matrix(cal_matrix, &cal);
+}
+
+void
+init_calibration(struct calibration *cal, int multi_device)
+{
+	memset(cal, 0, sizeof(*cal));
+	cal->multi_device = multi_device;
+	
+	// single device mode always has exactly one calibrator
+	if (!multi_device)
+		cal->num_calibrators = 1;
+}
+
+void
+release_calibration(struct calibration *cal)
+{
+	int i;
+	
+	for (i = 0; i < cal->num_calibrators; i++) {
+		if (cal->calibrators[i].device)
+			libinput_device_unref(cal->calibrators[i].device);
+		cal->calibrators[i].device = NULL;
+	}
+}
+
+/* True once every calibrator has a sample for its current test */
+int
+all_sampled(struct calibration *cal)
+{
+	int i;
+	
+	if (cal->num_calibrators == 0)
+		return 0;
+	
+	for (i = 0; i < cal->num_calibrators; i++) {
+		if (!cal->calibrators[i].got_sample)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Calibrator of a device, NULL for devices without one. In single device
+ * mode that is every device but the first: its axes and matrix reset do
+ * not apply to the others.
+ */
+static struct calibrator *
+find_calibrator(struct calibration *cal, struct libinput_device *device)
+{
+	int i;
+	
+	for (i = 0; i < cal->num_calibrators; i++) {
+		if (cal->calibrators[i].device == device)
+			return &cal->calibrators[i];
+	}
+	return NULL;
+}
+
+static void
+init_axis(struct touch_axis *axis, const struct input_absinfo *abs, double size_mm, int res)
+{
+	axis->minimum = abs->minimum;
+	axis->maximum = abs->maximum;
+	
+	// libinput reports (raw - minimum) / resolution in mm
+	axis->mm_scale = size_mm > 0 ? (abs->maximum - abs->minimum) / size_mm : 1;
+	
+	// same mapping as libinput_event_touch_get_x_transformed()
+	axis->screen_scale = res / ((double)abs->maximum - abs->minimum + 1);
+	axis->screen_offset = -abs->minimum * axis->screen_scale;
+}
+
+static int
+get_absinfo(int fd, int mt_code, int code, struct input_absinfo *abs)
+{
+	if (ioctl(fd, EVIOCGABS(mt_code), abs) == 0 && abs->maximum > abs->minimum)
+		return 0;
+	if (ioctl(fd, EVIOCGABS(code), abs) == 0 && abs->maximum > abs->minimum)
+		return 0;
+	return -1;
+}
+
+/*
+ * Query the axis ranges once per device and reset its calibration matrix,
+ * so samples are raw device units whatever the udev rules currently set.
+ */
+static void
+setup_touch_axes(struct calibrator *calibrator, struct libinput_device *device)
+{
+	static const float identity[6] = { 1, 0, 0, 0, 1, 0 };
+	struct udev_device *udev_device;
+	struct input_absinfo abs_x, abs_y;
+	double width = 0, height = 0;
+	const char *devnode = NULL;
+	float old[6];
+	int fd = -1;
+	
+	libinput_device_get_size(device, &width, &height);
+	
+	udev_device = libinput_device_get_udev_device(device);
+	if (udev_device) {
+		devnode = udev_device_get_devnode(udev_device);
+		if (devnode)
+			fd = open(devnode, O_RDONLY | O_NONBLOCK);
+		udev_device_unref(udev_device);
+	}
+	
+	if (fd < 0 || get_absinfo(fd, ABS_MT_POSITION_X, ABS_X, &abs_x) < 0 ||
+	    get_absinfo(fd, ABS_MT_POSITION_Y, ABS_Y, &abs_y) < 0) {
+		// without the ranges, millimetres are the raw unit
+		fprintf(fp_log, "%s: no axis ranges, using mm\n", libinput_device_get_sysname(device));
+		memset(&abs_x, 0, sizeof(abs_x));
+		memset(&abs_y, 0, sizeof(abs_y));
+		abs_x.maximum = width > 0 ? width : 1;
+		abs_y.maximum = height > 0 ? height : 1;
+		width = abs_x.maximum;
+		height = abs_y.maximum;
+	}
+	if (fd >= 0)
+		close(fd);
+	
+	init_axis(&calibrator->axis_x, &abs_x, width, xres);
+	init_axis(&calibrator->axis_y, &abs_y, height, yres);
+	fprintf(fp_log, "%s: x %d..%d, y %d..%d, %.1fx%.1f mm\n",
+		libinput_device_get_sysname(device),
+		abs_x.minimum, abs_x.maximum, abs_y.minimum, abs_y.maximum, width, height);
+	
+	if (libinput_device_config_calibration_has_matrix(device)) {
+		libinput_device_config_calibration_get_matrix(device, old);
+		fprintf(fp_log, "%s: replacing calibration %f %f %f %f %f %f by identity\n",
+			libinput_device_get_sysname(device),
+			old[0], old[1], old[2], old[3], old[4], old[5]);
+		libinput_device_config_calibration_set_matrix(device, identity);
+	}
+}
+
+/*
+ * The smoothing filter defaults to the command line, a CALTOOL_FILTER
+ * udev property selects it per device.
+ */
+static void
+setup_sample_filter(struct calibrator *calibrator, struct libinput_device *device)
+{
+	struct sample_filter *f = &calibrator->filter;
+	struct udev_device *udev_device;
+	const char *spec = NULL;
+	
+	memset(f, 0, sizeof(*f));
+	f->config = sample_filter_default;
+	
+	udev_device = libinput_device_get_udev_device(device);
+	if (udev_device) {
+		spec = udev_device_get_property_value(udev_device, "CALTOOL_FILTER");
+		if (spec && sample_filter_parse(&f->config, spec) < 0)
+			fprintf(fp_log, "%s: invalid CALTOOL_FILTER \"%s\", ignored\n",
+				libinput_device_get_sysname(device), spec);
+		udev_device_unref(udev_device);
+	}
+	
+	if (f->config.type == SAMPLE_FILTER_ONE_EURO)
+		fprintf(fp_log, "%s: filter oneeuro, min cutoff %.3f Hz, beta %.4f\n",
+			libinput_device_get_sysname(device), f->config.min_cutoff, f->config.beta);
+	else
+		fprintf(fp_log, "%s: filter %s\n",
+			libinput_device_get_sysname(device), sample_filter_name(&f->config));
+}
+
+/*
+ * A controller that re-enumerates comes back as a new libinput device,
+ * possibly with a new sysname. It is matched to its calibrator by name
+ * and USB ids, so the session continues with the samples taken so far.
+ */
+static int
+reattach_touch_device(struct calibration *cal, struct libinput_device *device)
+{
+	struct calibrator *calibrator;
+	int i;
+	
+	for (i = 0; i < cal->num_calibrators; i++) {
+		calibrator = &cal->calibrators[i];
+		if (!calibrator->detached ||
+		    calibrator->vendor != libinput_device_get_id_vendor(device) ||
+		    calibrator->product != libinput_device_get_id_product(device) ||
+		    strcmp(calibrator->name, libinput_device_get_name(device)) != 0)
+			continue;
+		
+		calibrator->device = libinput_device_ref(device);
+		calibrator->detached = 0;
+		setup_touch_axes(calibrator, device);
+		calibrator->reconnects++;
+		fprintf(fp_log, "%s reconnected as %s after %llu usec, continuing at test %d\n",
+			calibrator->sysname, libinput_device_get_sysname(device),
+			(unsigned long long)(monotonic_usec() - calibrator->detached_at),
+			calibrator->current_test);
+		return 0;
+	}
+	return -1;
+}
+
+static void
+add_touch_device(struct calibration *cal, struct libinput_device *device)
+{
+	struct calibrator *calibrator;
+	struct udev_device *udev_device;
+	const char *id_path;
+	
+	/*
+	* Nothing but touch events is of interest, so other devices are
+	* suspended by libinput. It closes their fds and they can no longer
+	* wake us up.
+	*/
+	if (!libinput_device_has_capability(device, LIBINPUT_DEVICE_CAP_TOUCH)) {
+		if (libinput_device_config_send_events_set_mode(device,
+				LIBINPUT_CONFIG_SEND_EVENTS_DISABLED) == LIBINPUT_CONFIG_STATUS_SUCCESS)
+			fprintf(fp_log, "Disabled non-touch device %s: %s\n",
+				libinput_device_get_sysname(device), libinput_device_get_name(device));
+		return;
+	}
+	
+	fprintf(fp_log, "Touch device %s: %s\n",
+		libinput_device_get_sysname(device), libinput_device_get_name(device));
+	
+	// -n picks one panel, e.g. the virtual one of tsinject
+	if (*device_name != '\0' && strcmp(libinput_device_get_name(device), device_name) != 0) {
+		if (libinput_device_config_send_events_set_mode(device,
+				LIBINPUT_CONFIG_SEND_EVENTS_DISABLED) == LIBINPUT_CONFIG_STATUS_SUCCESS)
+			fprintf(fp_log, "Disabled %s, not named %s\n",
+				libinput_device_get_sysname(device), device_name);
+		return;
+	}
+	
+	if (reattach_touch_device(cal, device) == 0)
+		return;
+	
+	if (cal->multi_device) {
+		// it would miss the targets already shown
+		if (cal->started) {
+			fprintf(fp_log, "Session already started, ignoring %s\n",
+				libinput_device_get_sysname(device));
+			return;
+		}
+		if (cal->num_calibrators >= MAX_TOUCH_DEVICES) {
+			fprintf(fp_log, "Too many touch devices, ignoring %s\n",
+				libinput_device_get_sysname(device));
+			return;
+		}
+		calibrator = &cal->calibrators[cal->num_calibrators++];
+	} else {
+		// single device mode follows the first device, touches on others are counted
+		calibrator = &cal->calibrators[0];
+		if (*calibrator->sysname != '\0')
+			return;
+	}
+	
+	calibrator->device = libinput_device_ref(device);
+	setup_touch_axes(calibrator, device);
+	setup_sample_filter(calibrator, device);
+	affine_rls_init(&calibrator->estimate, RLS_FORGET);
+	calibrator->vendor = libinput_device_get_id_vendor(device);
+	calibrator->product = libinput_device_get_id_product(device);
+	snprintf(calibrator->name, sizeof(calibrator->name), "%s",
+		 libinput_device_get_name(device));
+	snprintf(calibrator->sysname, sizeof(calibrator->sysname), "%s",
+		 libinput_device_get_sysname(device));
+	
+	udev_device = libinput_device_get_udev_device(device);
+	if (udev_device) {
+		id_path = udev_device_get_property_value(udev_device, "ID_PATH");
+		if (id_path)
+			snprintf(calibrator->id_path, sizeof(calibrator->id_path), "%s", id_path);
+		udev_device_unref(udev_device);
+	}
+}
+
+/* Forget the device but keep the samples, it may come back */
+static void
+remove_touch_device(struct calibration *cal, struct libinput_device *device)
+{
+	struct calibrator *calibrator;
+	int i;
+	
+	for (i = 0; i < cal->num_calibrators; i++) {
+		calibrator = &cal->calibrators[i];
+		if (calibrator->device != device)
+			continue;
+		
+		libinput_device_unref(calibrator->device);
+		calibrator->device = NULL;
+		calibrator->detached = 1;
+		calibrator->detached_at = monotonic_usec();
+		
+		// a touch in progress is lost with the device
+		memset(&calibrator->slots.down, 0, sizeof(calibrator->slots.down));
+		calibrator->slots.active = 0;
+		calibrator->slots.contaminated = 0;
+		calibrator->capture.active = 0;
+		calibrator->pending = 0;
+		
+		fprintf(fp_log, "%s removed during test %d, waiting for it to return\n",
+			calibrator->sysname, calibrator->current_test);
+	}
+}
+
+static void
+get_touch_point(struct calibrator *calibrator, struct libinput_event *ev, struct touch_point *p)
+{
+	struct libinput_event_touch *t = libinput_event_get_touch_event(ev);
+	const struct touch_axis *ax = &calibrator->axis_x;
+	const struct touch_axis *ay = &calibrator->axis_y;
+	
+	// kernel timestamp, used as reference for the latency statistics
+	p->time = libinput_event_touch_get_time_usec(t);
+	
+	// raw device units and screen coordinates from the cached axis ranges
+	p->raw_x = ax->minimum + libinput_event_touch_get_x(t) * ax->mm_scale;
+	p->raw_y = ay->minimum + libinput_event_touch_get_y(t) * ay->mm_scale;
+	
+	p->x = p->raw_x * ax->screen_scale + ax->screen_offset;
+	p->y = p->raw_y * ay->screen_scale + ay->screen_offset;
+}
+
+/*
+ * Smooth a position in screen coordinates and derive the raw units from
+ * the result, so both stay consistent.
+ */
+static void
+filter_touch_point(struct calibrator *calibrator, struct touch_point *p)
+{
+	const struct touch_axis *ax = &calibrator->axis_x;
+	const struct touch_axis *ay = &calibrator->axis_y;
+	
+	if (calibrator->filter.config.type == SAMPLE_FILTER_NONE)
+		return;
+	
+	sample_filter_apply(&calibrator->filter, &p->x, &p->y, p->time);
+	p->raw_x = (p->x - ax->screen_offset) / ax->screen_scale;
+	p->raw_y = (p->y - ay->screen_offset) / ay->screen_scale;
+}
+
+/*
+ * Store a candidate sample for the current test. It only becomes the
+ * test's sample when the touch session ends cleanly, see handle_touch().
+ */
+static void
+store_sample(struct calibrator *calibrator, const struct touch_point *p,
+	     unsigned long samples, double spread_x, double spread_y)
+{
+	struct tests *test = &calibrator->tests[calibrator->current_test];
+	
+	// write to current test ratio, keeping the sub-pixel part
+	test->clicked_x = p->x;
+	test->clicked_y = p->y;
+	test->raw_x = p->raw_x;
+	test->raw_y = p->raw_y;
+	test->samples = samples;
+	test->spread_x = spread_x;
+	test->spread_y = spread_y;
+	calibrator->pending = 1;
+	
+	fprintf(fp_log,"%s Iteration: %d Clicked X,Y: %f (%f), %f (%f)    Drawn X,Y: %f, %f    Samples: %lu Spread: %f, %f    Filtered: %f\n",
+		calibrator->sysname, calibrator->current_test,
+		p->x, p->raw_x, p->y, p->raw_y, test->drawn_x, test->drawn_y,
+		samples, spread_x, spread_y, calibrator->filter.last_shift);
+}
+
+static void
+capture_add(struct capture *capture, const struct touch_point *p)
+{
+	capture->last = *p;
+	running_stats_add(&capture->x, p->x);
+	running_stats_add(&capture->y, p->y);
+	running_stats_add(&capture->raw_x, p->raw_x);
+	running_stats_add(&capture->raw_y, p->raw_y);
+}
+
+static void
+capture_restart(struct capture *capture, const struct touch_point *p)
+{
+	running_stats_reset(&capture->x);
+	running_stats_reset(&capture->y);
+	running_stats_reset(&capture->raw_x);
+	running_stats_reset(&capture->raw_y);
+	capture->start = p->time;
+	capture_add(capture, p);
+}
+
+/*
+ * Dwell capture: positions between touch down and up are accumulated until
+ * both axes stay below dwell_variance for DWELL_MIN_SAMPLES positions.
+ * If the finger moves too much the statistics start over at the current
+ * position, so the landing motion does not count against the sample.
+ * Captures that never get there are decided at touch up, dwell_finish().
+ */
+static void
+dwell_update(struct calibrator *calibrator, const struct touch_point *p)
+{
+	struct capture *capture = &calibrator->capture;
+	struct touch_point mean;
+	double var_x, var_y;
+	
+	capture_add(capture, p);
+	
+	var_x = running_stats_variance(&capture->x);
+	var_y = running_stats_variance(&capture->y);
+	
+	if (var_x > dwell_variance || var_y > dwell_variance) {
+		capture_restart(capture, p);
+		return;
+	}
 	
-	memset(&rot_matrix, 0, sizeof(rot_matrix));
+	if (capture->x.n < DWELL_MIN_SAMPLES)
+		return;
 	
-	switch (rotation) {
-		case 0:
+	mean.x = capture->x.mean;
+	mean.y = capture->y.mean;
+	mean.raw_x = capture->raw_x.mean;
+	mean.raw_y = capture->raw_y.mean;
+	mean.time = p->time;
+	
+	store_sample(calibrator, &mean, capture->x.n, sqrt(var_x), sqrt(var_y));
+	capture->active = 0;
+}
+
+/*
+ * Touch up during a dwell capture. Every position in it is within
+ * dwell_variance, so it is a sample if the finger rested DWELL_MIN_USEC
+ * until now, however few positions a still finger reported.
+ */
+static void
+dwell_finish(struct calibrator *calibrator, uint64_t time)
+{
+	struct capture *capture = &calibrator->capture;
+	struct touch_point mean;
+	
+	if (time < capture->start + DWELL_MIN_USEC) {
+		fprintf(fp_log, "%s Iteration: %d released before stable after %lu samples\n",
+			calibrator->sysname, calibrator->current_test, capture->x.n);
+		return;
+	}
+	
+	mean.x = capture->x.mean;
+	mean.y = capture->y.mean;
+	mean.raw_x = capture->raw_x.mean;
+	mean.raw_y = capture->raw_y.mean;
+	mean.time = time;
+	
+	store_sample(calibrator, &mean, capture->x.n,
+		     sqrt(running_stats_variance(&capture->x)),
+		     sqrt(running_stats_variance(&capture->y)));
+}
+
+/*
+ * Track which seat slots are in contact. Returns 0 for events of a
+ * tracked slot and -1 for slots outside the table.
+ */
+static int
+update_slots(struct touch_slots *slots, enum libinput_event_type type, int32_t slot)
+{
+	if (slot < 0 || slot >= MAX_TOUCH_SLOTS) {
+		slots->rejected_slot++;
+		// a contact we cannot follow, never trust this session
+		slots->contaminated = 1;
+		return -1;
+	}
+	
+	switch (type) {
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+		if (!slots->down[slot]) {
+			slots->down[slot] = 1;
+			slots->active++;
+		}
+		if (slots->active > 1)
+			slots->contaminated = 1;
+		break;
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+		slots->contaminated = 1;
+		/* fall through */
+	case LIBINPUT_EVENT_TOUCH_UP:
+		if (slots->down[slot]) {
+			slots->down[slot] = 0;
+			slots->active--;
+		}
 		break;
-		case 1: // 90 deg
-			// define rotation matrix
-			rot_matrix.d[1] = 1;
-			rot_matrix.d[4] = -1;
-			rot_matrix.d[8] = 1;
-			rot_matrix.d[10] = 1;
-			rot_matrix.d[15] = 1;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/* Forward contacts to the live markers, independent of the samples */
+static void
+live_feedback(struct feedback *fb, struct calibrator *calibrator, struct libinput_event *ev)
+{
+	struct libinput_event_touch *t = libinput_event_get_touch_event(ev);
+	struct touch_point p;
+	
+	if (!fb->enabled || calibrator == NULL)
+		return;
+	
+	switch (libinput_event_get_type(ev)) {
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+		get_touch_point(calibrator, ev, &p);
+		feedback_down(fb, libinput_event_touch_get_seat_slot(t), p.x, p.y, p.time);
+		break;
+	case LIBINPUT_EVENT_TOUCH_MOTION:
+		get_touch_point(calibrator, ev, &p);
+		feedback_motion(fb, libinput_event_touch_get_seat_slot(t), p.x, p.y, p.time);
+		break;
+	case LIBINPUT_EVENT_TOUCH_UP:
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+		feedback_up(fb, libinput_event_touch_get_seat_slot(t));
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Add a target to the live estimate and log it with the error it had
+ * before. A retaken target replaces its old sample, so the estimate is
+ * rebuilt from the others then, which is rare.
+ */
+static void
+update_estimate(struct calibrator *calibrator, int current)
+{
+	struct affine_rls *rls = &calibrator->estimate;
+	const double *c = rls->coef;
+	struct tests *test;
+	double x, y, u, v;
+	int i;
+	
+	if (calibrator->tests[current].outlier) {
+		affine_rls_init(rls, rls->forget);
+		for (i = 0; i < calibrator->num_tests; i++) {
+			test = &calibrator->tests[i];
+			if (i == current || test->outlier)
+				continue;
+			affine_rls_add(rls, normalize_raw(&calibrator->axis_x, test->raw_x),
+				       normalize_raw(&calibrator->axis_y, test->raw_y),
+				       test->drawn_x / xres, test->drawn_y / yres);
+		}
+	}
+	
+	test = &calibrator->tests[current];
+	x = normalize_raw(&calibrator->axis_x, test->raw_x);
+	y = normalize_raw(&calibrator->axis_y, test->raw_y);
+	u = test->drawn_x / xres;
+	v = test->drawn_y / yres;
+	
+	// a priori, the estimate from the targets before this one
+	if (rls->n >= 3)
+		fprintf(fp_log, "%s Iteration: %d predicted off by %f, %f px\n",
+			calibrator->sysname, current,
+			(c[0] * x + c[1] * y + c[2] - u) * xres,
+			(c[3] * x + c[4] * y + c[5] - v) * yres);
+	
+	affine_rls_add(rls, x, y, u, v);
+	fprintf(fp_log, "%s Live estimate after %lu targets: %f %f %f %f %f %f\n",
+		calibrator->sysname, rls->n, c[0], c[1], c[2], c[3], c[4], c[5]);
+}
+
+/*
+ * A touch session lasts from the first contact until all contacts are
+ * lifted. Its sample is accepted only if it stayed a single contact, a
+ * second finger or palm discards the whole session.
+ */
+static void
+handle_touch(struct calibrator *calibrator, struct libinput_event *ev, uint64_t dispatched)
+{
+	struct libinput_event_touch *t = libinput_event_get_touch_event(ev);
+	enum libinput_event_type type = libinput_event_get_type(ev);
+	struct touch_slots *slots;
+	struct tests *test;
+	struct touch_point p;
+	
+	if (calibrator == NULL)
+		return;
+	
+	// contacts are tracked even when this test is already done
+	slots = &calibrator->slots;
+	update_slots(slots, type, libinput_event_touch_get_seat_slot(t));
+	
+	if (calibrator->got_sample)
+		return;
+	
+	if (slots->contaminated && type != LIBINPUT_EVENT_TOUCH_UP &&
+	    type != LIBINPUT_EVENT_TOUCH_CANCEL) {
+		slots->rejected_multi++;
+		calibrator->capture.active = 0;
+		return;
+	}
+	
+	switch (type) {
+	case LIBINPUT_EVENT_TOUCH_DOWN:
+		get_touch_point(calibrator, ev, &p);
+		sample_filter_reset(&calibrator->filter);
+		filter_touch_point(calibrator, &p);
+		if (dwell_variance <= 0 && calibrator->filter.config.type == SAMPLE_FILTER_NONE) {
+			store_sample(calibrator, &p, 1, 0, 0);
 			break;
-		case 2: // 180 deg
-			// define rotation matrix
-			rot_matrix.d[0] = -1;
-			rot_matrix.d[2] = 1;
-			rot_matrix.d[5] = -1;
-			rot_matrix.d[6] = 1;
-			rot_matrix.d[8] = 1;
-			rot_matrix.d[9] = 1;
-			rot_matrix.d[10] = 1;
-			rot_matrix.d[15] = 1;
+		}
+		calibrator->capture.active = 1;
+		capture_restart(&calibrator->capture, &p);
+		break;
+	case LIBINPUT_EVENT_TOUCH_MOTION:
+		if (!calibrator->capture.active)
 			break;
-		case 3: // 270 deg	// Still buggy !!!
-			// define rotation matrix
-			rot_matrix.d[1] = -1;
-			//rot_matrix.d[2] = -1;
-			rot_matrix.d[4] = 1;
-			//rot_matrix.d[8] = 1;
-			rot_matrix.d[10] = 1;
-			rot_matrix.d[15] = 1;
+		get_touch_point(calibrator, ev, &p);
+		filter_touch_point(calibrator, &p);
+		if (dwell_variance > 0)
+			dwell_update(calibrator, &p);
+		else
+			capture_add(&calibrator->capture, &p);
+		break;
+	case LIBINPUT_EVENT_TOUCH_UP:
+	case LIBINPUT_EVENT_TOUCH_CANCEL:
+		if (slots->active > 0)
 			break;
+		
+		// last contact lifted, the session is over
+		if (calibrator->capture.active && dwell_variance <= 0)
+			// filtered without dwell, the sample is where the filter settled
+			store_sample(calibrator, &calibrator->capture.last,
+				     calibrator->capture.x.n, 0, 0);
+		else if (calibrator->capture.active)
+			dwell_finish(calibrator, libinput_event_touch_get_time_usec(t));
+		
+		if (calibrator->pending && slots->contaminated) {
+			slots->rejected_sessions++;
+			fprintf(fp_log, "%s Iteration: %d discarded, concurrent contacts\n",
+				calibrator->sysname, calibrator->current_test);
+		} else if (calibrator->pending) {
+			// the feedback is caused by this event
+			test = &calibrator->tests[calibrator->current_test];
+			test->time.event = libinput_event_touch_get_time_usec(t);
+			test->time.dispatch = dispatched;
+			test->time.processed = monotonic_usec();
+			calibrator->got_sample = 1;
+			update_estimate(calibrator, calibrator->current_test);
+		}
+		
+		calibrator->capture.active = 0;
+		calibrator->pending = 0;
+		slots->contaminated = 0;
+		break;
+	default:
+		break;
 	}
+}
+
+void
+print_touch_counters(FILE *fp, struct calibration *cal)
+{
+	struct sample_filter *filter;
+	struct touch_slots *slots;
+	int i;
 	
-	if (rotation > 0)
-	{
-		// multiply matrix
-		weston_matrix_multiply(cal_matrix, &rot_matrix);
+	for (i = 0; i < cal->num_calibrators; i++) {
+		slots = &cal->calibrators[i].slots;
+		fprintf(fp, "%s rejected: %lu multi-contact events, %lu sessions, %lu untracked slots\n",
+			cal->calibrators[i].sysname, slots->rejected_multi,
+			slots->rejected_sessions, slots->rejected_slot);
+		fprintf(fp, "%s reconnects: %lu\n",
+			cal->calibrators[i].sysname, cal->calibrators[i].reconnects);
+		filter = &cal->calibrators[i].filter;
+		if (filter->config.type != SAMPLE_FILTER_NONE)
+			fprintf(fp, "%s filter %s: %lu positions moved %f avg, %f max\n",
+				cal->calibrators[i].sysname, sample_filter_name(&filter->config),
+				filter->shift.n, filter->shift.mean, filter->max_shift);
 	}
-	
 }
 
-void 
-get_touch_coordinates(struct libinput_event *ev, struct calibrator *calibrator)
+/*
+ * libinput only reports lost events through its log: the kernel buffer
+ * overran (SYN_DROPPED) or events waited too long to be read. The
+ * messages are rate limited, so the counts are lower bounds.
+ */
+static void
+log_handler(struct libinput *li, enum libinput_log_priority priority,
+	    const char *format, va_list args)
 {
-	struct libinput_event_touch *t = libinput_event_get_touch_event(ev);
-	double x,x_raw;
-	double y,y_raw;
+	struct calibration *cal = libinput_get_user_data(li);
+	char msg[256];
 	
-	// get current screen coordinates
-	x = libinput_event_touch_get_x_transformed(t, xres);
-	y = libinput_event_touch_get_y_transformed(t, yres);
+	vsnprintf(msg, sizeof(msg), format, args);
+	fprintf(fp_log, "libinput: %s", msg);
 	
-	x_raw = libinput_event_touch_get_x(t);
-	y_raw = libinput_event_touch_get_y(t);
+	if (cal == NULL)
+		return;
 	
-	// write to current test ratio
-	calibrator->tests[calibrator->current_test].clicked_x = (int) x;
-	calibrator->tests[calibrator->current_test].clicked_y = (int) y;
+	if (strstr(msg, "SYN_DROPPED")) {
+		cal->health.syn_dropped++;
+		cal->health.resync_pending = 1;
+	} else if (strstr(msg, "lagging behind")) {
+		cal->health.lagging++;
+	}
+}
+
+/*
+ * libinput resyncs the device itself, but a touch up may be among the
+ * lost events. Forget all contacts and unfinished samples, so no
+ * calibrator keeps waiting for a finger that is long gone.
+ */
+static void
+resync_touch_state(struct calibration *cal)
+{
+	struct calibrator *calibrator;
+	int i;
 	
-	fprintf(fp_log,"Iteration: %d Clicked X,Y: %f (%f), %f (%f)    Drawn X,Y: %f, %f\n",calibrator->current_test, x,x_raw,y,y_raw, calibrator->tests[calibrator->current_test].drawn_x,calibrator->tests[calibrator->current_test].drawn_y);
+	for (i = 0; i < cal->num_calibrators; i++) {
+		calibrator = &cal->calibrators[i];
+		memset(&calibrator->slots.down, 0, sizeof(calibrator->slots.down));
+		calibrator->slots.active = 0;
+		calibrator->slots.contaminated = 0;
+		calibrator->capture.active = 0;
+		calibrator->pending = 0;
+	}
+	feedback_clear(&cal->feedback);
+	
+	cal->health.resync_pending = 0;
+	cal->health.resyncs++;
+	fprintf(fp_log, "Events dropped, touch state reset\n");
+}
+
+void
+print_input_health(FILE *fp, struct calibration *cal)
+{
+	struct input_health *h = &cal->health;
+	
+	fprintf(fp, "Dropped events: %lu SYN_DROPPED, %lu lagging, %lu resyncs\n",
+		h->syn_dropped, h->lagging, h->resyncs);
+	fprintf(fp, "Dispatch batches: %lu, events per batch avg %.1f max %lu, usec per batch avg %.1f max %llu\n",
+		h->batches, h->batch_size.mean, h->max_batch,
+		h->dispatch_usec.mean, (unsigned long long)h->max_dispatch_usec);
 }
 
 int 
-handle_events(struct libinput *li, struct calibrator *calibrator)
+handle_events(struct libinput *li, struct calibration *cal)
 {
 	int rc = -1;
+	struct calibrator *calibrator;
 	struct libinput_event *ev;
+	uint64_t dispatched, start, elapsed;
+	unsigned long batch = 0;
 
+	start = monotonic_usec();
 	libinput_dispatch(li);
+	if (cal->health.resync_pending)
+		resync_touch_state(cal);
+	
 	while ((ev = libinput_get_event(li))) {
+		batch++;
+		dispatched = monotonic_usec();
 		//print_event_header(ev);
 
 		switch (libinput_event_get_type(ev)) {
 		case LIBINPUT_EVENT_NONE:
 			abort();
 		case LIBINPUT_EVENT_DEVICE_ADDED:
+			add_touch_device(cal, libinput_event_get_device(ev));
+			break;
 		case LIBINPUT_EVENT_DEVICE_REMOVED:
-			//print_device_notify(ev);
+			remove_touch_device(cal, libinput_event_get_device(ev));
 			break;
 		case LIBINPUT_EVENT_KEYBOARD_KEY:
 			//print_key_event(ev);
+			cal->ignored_events++;
 			break;
 		case LIBINPUT_EVENT_POINTER_MOTION:
 			//print_motion_event(ev);
+			cal->ignored_events++;
 			break;
 		case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
 			//print_absmotion_event(ev);
+			cal->ignored_events++;
 			break;
 		case LIBINPUT_EVENT_POINTER_BUTTON:
 			//print_button_event(ev);
+			cal->ignored_events++;
 			break;
 		case LIBINPUT_EVENT_POINTER_AXIS:
 			//print_axis_event(ev);
+			cal->ignored_events++;
 			break;
 		case LIBINPUT_EVENT_TOUCH_DOWN:
-			get_touch_coordinates(ev, calibrator);
-			got_sample=1;
-			break;
 		case LIBINPUT_EVENT_TOUCH_MOTION:
-			//print_touch_event_with_coords(ev);
-			break;
 		case LIBINPUT_EVENT_TOUCH_UP:
-			//print_touch_event_without_coords(ev);
-			break;
 		case LIBINPUT_EVENT_TOUCH_CANCEL:
-			//print_touch_event_without_coords(ev);
+			calibrator = find_calibrator(cal, libinput_event_get_device(ev));
+			if (calibrator == NULL) {
+				cal->foreign_events++;
+				break;
+			}
+			live_feedback(&cal->feedback, calibrator, ev);
+			handle_touch(calibrator, ev, dispatched);
+			got_sample = all_sampled(cal);
 			break;
 		case LIBINPUT_EVENT_TOUCH_FRAME:
 			//print_touch_event_without_coords(ev);
@@ -262,16 +1191,91 @@ handle_events(struct libinput *li, struct calibrator *calibrator)
 
 		libinput_event_destroy(ev);
 		libinput_dispatch(li);
+		if (cal->health.resync_pending)
+			resync_touch_state(cal);
 		rc = 0;
 	}
+	
+	// queue depth and dispatch time of this batch
+	if (batch > 0) {
+		elapsed = monotonic_usec() - start;
+		cal->health.batches++;
+		running_stats_add(&cal->health.batch_size, batch);
+		running_stats_add(&cal->health.dispatch_usec, elapsed);
+		if (batch > cal->health.max_batch)
+			cal->health.max_batch = batch;
+		if (elapsed > cal->health.max_dispatch_usec)
+			cal->health.max_dispatch_usec = elapsed;
+	}
 	return rc;
 }
 
+#define BITS_PER_LONG (sizeof(unsigned long) * 8)
+#define NLONGS(x) (((x) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+static int
+test_bit(const unsigned long *bits, int bit)
+{
+	return (bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG)) & 1;
+}
+
+/* Touch screens report BTN_TOUCH together with absolute positions */
+static int
+is_touch_fd(int fd)
+{
+	unsigned long key_bits[NLONGS(KEY_CNT)];
+	unsigned long abs_bits[NLONGS(ABS_CNT)];
+	
+	memset(key_bits, 0, sizeof(key_bits));
+	memset(abs_bits, 0, sizeof(abs_bits));
+	
+	if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits) < 0 ||
+	    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits) < 0)
+		return 1;	/* unknown, better keep it */
+	
+	return test_bit(key_bits, BTN_TOUCH) &&
+	       (test_bit(abs_bits, ABS_X) || test_bit(abs_bits, ABS_MT_POSITION_X));
+}
+
+/*
+ * Ask the kernel not to queue any event of a device, so it never wakes
+ * the process. Needs EVIOCSMASK (Linux 4.4), older kernels are left alone.
+ */
+static void
+mask_device_events(int fd, const char *path)
+{
+	static const unsigned int types[] = {
+		EV_SYN, EV_KEY, EV_REL, EV_ABS, EV_MSC, EV_SW
+	};
+#ifdef EVIOCSMASK
+	unsigned long codes[NLONGS(KEY_CNT)];
+	struct input_mask mask;
+	unsigned int i;
+	
+	// all bits cleared, no code of the type is delivered
+	memset(codes, 0, sizeof(codes));
+	for (i = 0; i < ARRAY_LENGTH(types); i++) {
+		mask.type = types[i];
+		mask.codes_size = sizeof(codes);
+		mask.codes_ptr = (uintptr_t)codes;
+		if (ioctl(fd, EVIOCSMASK, &mask) < 0)
+			return;
+	}
+	fprintf(fp_log, "Masked events of non-touch device %s\n", path);
+#endif
+}
+
 int
 open_restricted(const char *path, int flags, void *user_data)
 {
 	int fd = open(path, flags);
-	return fd < 0 ? -errno : fd;
+	if (fd < 0)
+		return -errno;
+	
+	if (!is_touch_fd(fd))
+		mask_device_events(fd, path);
+	
+	return fd;
 }
 
 void
@@ -286,7 +1290,7 @@ const struct libinput_interface interface = {
 };
 
 int
-open_udev(struct libinput **li)
+open_udev(struct libinput **li, struct calibration *cal)
 {
 	udev = udev_new();
 	if (!udev) {
@@ -294,11 +1298,15 @@ open_udev(struct libinput **li)
 		return 1;
 	}
 
-	*li = libinput_udev_create_context(&interface, NULL, udev);
+	*li = libinput_udev_create_context(&interface, cal, udev);
 	if (!*li) {
 		fprintf(stderr, "Failed to initialize context from udev\n");
 		return 1;
 	}
+	
+	// dropped events are only visible in the log
+	libinput_log_set_handler(*li, log_handler);
+	libinput_log_set_priority(*li, LIBINPUT_LOG_PRIORITY_INFO);
 
 	if (libinput_udev_assign_seat(*li, seat)) {
 		fprintf(stderr, "Failed to set seat\n");
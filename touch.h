@@ -1,29 +1,134 @@
 #include <libinput.h>
 #include "matrix.h"
+#include "stats.h"
+#include "feedback.h"
+#include "layout.h"
+#include "correction.h"
+#include "homography.h"
+#include "solver.h"
+#include "fixed.h"
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
-/* Our points for the calibration must be not be on a line */
-static const struct {
-	float x_ratio, y_ratio;
-	} test_ratios[] = {
-	{ 0.20, 0.40 },
-	{ 0.80, 0.60 },
-	{ 0.40, 0.80 }
+/* Minimum number of touch positions before a dwell capture may be accepted */
+#define DWELL_MIN_SAMPLES 8
+
+/*
+ * A finger held perfectly still sends no motion events at all, evdev drops
+ * unchanged values. At touch up a capture that rested this long counts too.
+ */
+#define DWELL_MIN_USEC 100000
+
+/* Seat slots followed for multi-contact rejection */
+#define MAX_TOUCH_SLOTS 16
+
+struct touch_slots {
+	unsigned char down[MAX_TOUCH_SLOTS];
+	int active;			/* contacts currently down */
+	int contaminated;		/* more than one contact this session */
+	unsigned long rejected_multi;	/* events dropped during multi-contact */
+	unsigned long rejected_sessions;/* samples discarded at touch up */
+	unsigned long rejected_slot;	/* events with a slot outside the table */
+};
+
+/*
+ * Absolute axis of a touch device, queried once when it is added. Raw
+ * device units and screen pixels are each one multiply-add away from the
+ * libinput millimetre value.
+ */
+struct touch_axis {
+	int32_t minimum, maximum;
+	double mm_scale;			/* raw = minimum + mm * mm_scale */
+	double screen_scale, screen_offset;	/* px = raw * scale + offset */
+};
+
+/* One touch position as reported by libinput */
+struct touch_point {
+	double x, y;		/* screen pixels */
+	double raw_x, raw_y;	/* raw device units */
+	uint64_t time;		/* kernel timestamp, usec */
 };
 
+/* Upper limit for touch devices calibrated in one session */
+#define MAX_TOUCH_DEVICES 4
+
 struct calibrator {
+	struct libinput_device *device;	/* followed device, NULL while detached */
+	char name[64];
+	char sysname[32];		/* as first seen, names the output files */
+	char id_path[128];		/* udev ID_PATH, tells identical controllers apart */
+	unsigned int vendor, product;
+	int detached;
+	uint64_t detached_at;
+	unsigned long reconnects;
+	struct touch_axis axis_x, axis_y;
 	struct tests {
 		double drawn_x, drawn_y;
-		double clicked_x, clicked_y;
-	} tests[ARRAY_LENGTH(test_ratios)];
+		double clicked_x, clicked_y;	/* screen pixels, sub-pixel resolution */
+		double raw_x, raw_y;		/* raw device units */
+		unsigned long samples;		/* touch positions averaged */
+		double spread_x, spread_y;	/* their standard deviation */
+		double residual_x, residual_y;	/* fitted minus drawn, pixels */
+		unsigned char outlier;		/* left out of the fit */
+		struct sample_times time;
+	} tests[MAX_TESTS];
+	int num_tests;		/* tests with a sample, from the first */
 	int current_test;
+	int got_sample;
+	int pending;		/* sample stored, waiting for the touch up */
+	
+	struct touch_slots slots;
+	
+	/* dwell capture between touch down and up */
+	struct capture {
+		int active;
+		struct running_stats x, y;
+		struct running_stats raw_x, raw_y;
+		struct touch_point last;
+		uint64_t start;		/* event time of the first position */
+	} capture;
+	struct sample_filter filter;
+	struct affine_rls estimate;	/* live calibration, updated per target */
+};
+
+/* Signs of lost input and how much work each dispatch batch is */
+struct input_health {
+	unsigned long syn_dropped;	/* kernel buffer overruns reported by libinput */
+	unsigned long lagging;		/* libinput noticed events queued for too long */
+	unsigned long resyncs;		/* touch state thrown away after a drop */
+	int resync_pending;
+	unsigned long batches;
+	unsigned long max_batch;
+	uint64_t max_dispatch_usec;
+	struct running_stats batch_size;	/* events per handle_events() call */
+	struct running_stats dispatch_usec;	/* time per handle_events() call */
+};
+
+/* All calibrators of a session, events are routed to them by device */
+struct calibration {
+	struct calibrator calibrators[MAX_TOUCH_DEVICES];
+	int num_calibrators;
+	int multi_device;
+	int started;			/* first target shown, no new devices */
+	unsigned long wakeups;		/* poll() returns in the sample loop */
+	unsigned long ignored_events;	/* non-touch events dispatched anyway */
+	unsigned long foreign_events;	/* touch events of devices not calibrated */
+	struct feedback feedback;	/* live touch markers */
+	struct input_health health;
 };
 
 void print_touch_event_with_coords(struct libinput_event *);
-int handle_events(struct libinput *, struct calibrator *);
+void init_calibration(struct calibration *, int);
+void release_calibration(struct calibration *);
+int all_sampled(struct calibration *);
+int handle_events(struct libinput *, struct calibration *);
+void print_touch_counters(FILE *, struct calibration *);
+void print_input_health(FILE *, struct calibration *);
 int open_restricted(const char *, int, void *);
 void close_restricted(int , void *);
-int open_udev(struct libinput **);
-void finish_calibration (struct calibrator *, struct weston_matrix *);
+int open_udev(struct libinput **, struct calibration *);
+int finish_calibration (struct calibrator *, struct weston_matrix *);
+int find_outliers(struct calibrator *, double);
+int finish_projective(struct calibrator *, struct weston_matrix *);
+int finish_correction(struct calibrator *, const struct weston_matrix *, struct correction_grid *);
 void rotate_calibration_matrix(struct weston_matrix *, int );
\ No newline at end of file
@@ -0,0 +1,400 @@
+/*
+	tsinject - synthetic touch screen for caltool - http://www.openvario.org/
+    Copyright (C) 2014  The openvario project
+    A detailed list of copyright holders can be found in the file "AUTHORS"
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Creates a virtual touch screen through /dev/uinput and taps the targets
+ * caltool draws, so a calibration session can be run and timed without a
+ * finger. The touched position is the target passed through an affine
+ * distortion plus gaussian noise, which gives caltool a known answer.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/fcntl.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <linux/fb.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "layout.h"
+#include "stats.h"
+#include "version.h"
+
+/* Device coordinate range of the virtual touch screen */
+#define INJECT_ABS_MAX	4095
+#define INJECT_SLOTS	10
+
+static int xres = 0, yres = 0;
+static double distortion[6] = { 1, 0, 0, 0, 1, 0 };
+static double noise = 0;
+static unsigned int interval_ms = 500;
+static unsigned int frame_us = 10000;
+static unsigned int frames = 10;
+static unsigned int delay_ms = 2000;
+static unsigned long burst = 0;
+static unsigned int seed = 1;
+static struct test_layout layout;
+static unsigned long events_written = 0;
+
+static void
+sleep_usec(unsigned long usec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = (usec % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+/* Box-Muller, deterministic for a given seed */
+static double
+gaussian(void)
+{
+	double u1, u2;
+
+	do {
+		u1 = rand_r(&seed) / ((double)RAND_MAX + 1);
+	} while (u1 <= 0);
+	u2 = rand_r(&seed) / ((double)RAND_MAX + 1);
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static int
+emit(int fd, __u16 type, __u16 code, __s32 value)
+{
+	struct input_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+
+	if (write(fd, &ev, sizeof(ev)) != sizeof(ev)) {
+		perror("write uinput");
+		return -1;
+	}
+	events_written++;
+	return 0;
+}
+
+/* Screen pixels to device units, the inverse of libinput's transform */
+static __s32
+to_device(double pos, int res)
+{
+	double v = pos * (INJECT_ABS_MAX + 1) / res;
+
+	if (v < 0)
+		v = 0;
+	if (v > INJECT_ABS_MAX)
+		v = INJECT_ABS_MAX;
+	return (__s32)(v + 0.5);
+}
+
+static int
+emit_position(int fd, double x, double y)
+{
+	__s32 dx = to_device(x, xres);
+	__s32 dy = to_device(y, yres);
+
+	if (emit(fd, EV_ABS, ABS_MT_POSITION_X, dx) ||
+	    emit(fd, EV_ABS, ABS_MT_POSITION_Y, dy) ||
+	    emit(fd, EV_ABS, ABS_X, dx) ||
+	    emit(fd, EV_ABS, ABS_Y, dy))
+		return -1;
+	return 0;
+}
+
+/* One tap: touch down, frames-1 motion reports, touch up */
+static int
+tap(int fd, double x, double y, int tracking_id)
+{
+	unsigned int i;
+
+	if (emit(fd, EV_ABS, ABS_MT_SLOT, 0) ||
+	    emit(fd, EV_ABS, ABS_MT_TRACKING_ID, tracking_id) ||
+	    emit_position(fd, x + noise * gaussian(), y + noise * gaussian()) ||
+	    emit(fd, EV_KEY, BTN_TOUCH, 1) ||
+	    emit(fd, EV_SYN, SYN_REPORT, 0))
+		return -1;
+
+	for (i = 1; i < frames; i++) {
+		sleep_usec(frame_us);
+		if (emit_position(fd, x + noise * gaussian(), y + noise * gaussian()) ||
+		    emit(fd, EV_SYN, SYN_REPORT, 0))
+			return -1;
+	}
+
+	sleep_usec(frame_us);
+	if (emit(fd, EV_ABS, ABS_MT_TRACKING_ID, -1) ||
+	    emit(fd, EV_KEY, BTN_TOUCH, 0) ||
+	    emit(fd, EV_SYN, SYN_REPORT, 0))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Report motion as fast as possible while caltool waits for the first
+ * target. A second contact is held all along, so caltool counts the
+ * events through its input path but discards the session as a two
+ * finger touch, and the taps that follow are not disturbed.
+ */
+static int
+flood(int fd, unsigned long count)
+{
+	unsigned long i;
+	double x = xres / 2, y = yres / 2;
+
+	if (emit(fd, EV_ABS, ABS_MT_SLOT, 1) ||
+	    emit(fd, EV_ABS, ABS_MT_TRACKING_ID, INJECT_SLOTS) ||
+	    emit_position(fd, x / 2, y / 2) ||
+	    emit(fd, EV_ABS, ABS_MT_SLOT, 0) ||
+	    emit(fd, EV_ABS, ABS_MT_TRACKING_ID, INJECT_SLOTS + 1) ||
+	    emit_position(fd, x, y) ||
+	    emit(fd, EV_KEY, BTN_TOUCH, 1) ||
+	    emit(fd, EV_SYN, SYN_REPORT, 0))
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		if (emit_position(fd, x + (i & 7), y + ((i >> 3) & 7)) ||
+		    emit(fd, EV_SYN, SYN_REPORT, 0))
+			return -1;
+	}
+
+	if (emit(fd, EV_ABS, ABS_MT_TRACKING_ID, -1) ||
+	    emit(fd, EV_ABS, ABS_MT_SLOT, 1) ||
+	    emit(fd, EV_ABS, ABS_MT_TRACKING_ID, -1) ||
+	    emit(fd, EV_KEY, BTN_TOUCH, 0) ||
+	    emit(fd, EV_SYN, SYN_REPORT, 0))
+		return -1;
+
+	return 0;
+}
+
+static int
+open_uinput(void)
+{
+	struct uinput_user_dev dev;
+	int fd;
+
+	fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror("open /dev/uinput");
+		return -1;
+	}
+
+	if (ioctl(fd, UI_SET_EVBIT, EV_SYN) < 0 ||
+	    ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0 ||
+	    ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0 ||
+	    ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_X) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_Y) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_MT_SLOT) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_MT_TRACKING_ID) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_MT_POSITION_X) < 0 ||
+	    ioctl(fd, UI_SET_ABSBIT, ABS_MT_POSITION_Y) < 0 ||
+	    ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT) < 0) {
+		perror("ioctl uinput setup");
+		close(fd);
+		return -1;
+	}
+
+	memset(&dev, 0, sizeof(dev));
+	snprintf(dev.name, UINPUT_MAX_NAME_SIZE, "tsinject");
+	dev.id.bustype = BUS_VIRTUAL;
+	dev.id.vendor = 0x1d6b;
+	dev.id.product = 0x0104;
+	dev.id.version = 1;
+	dev.absmax[ABS_X] = INJECT_ABS_MAX;
+	dev.absmax[ABS_Y] = INJECT_ABS_MAX;
+	dev.absmax[ABS_MT_POSITION_X] = INJECT_ABS_MAX;
+	dev.absmax[ABS_MT_POSITION_Y] = INJECT_ABS_MAX;
+	dev.absmax[ABS_MT_SLOT] = INJECT_SLOTS - 1;
+	dev.absmax[ABS_MT_TRACKING_ID] = 65535;
+
+	if (write(fd, &dev, sizeof(dev)) != sizeof(dev) ||
+	    ioctl(fd, UI_DEV_CREATE) < 0) {
+		perror("create uinput device");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+get_resolution(void)
+{
+	struct fb_var_screeninfo var;
+	const char *fbdevice;
+	int fd;
+
+	if (xres > 0 && yres > 0)
+		return;
+
+	if ((fbdevice = getenv("TSLIB_FBDEVICE")) == NULL)
+		fbdevice = "/dev/fb0";
+
+	fd = open(fbdevice, O_RDONLY);
+	if (fd >= 0 && ioctl(fd, FBIOGET_VSCREENINFO, &var) == 0) {
+		xres = var.xres;
+		yres = var.yres;
+	}
+	if (fd >= 0)
+		close(fd);
+}
+
+static void
+usage(void)
+{
+	printf("Usage: tsinject [OPTION]\n\n"
+	       "  -v              			print version information\n"
+	       "  -x [xres] -y [yres]		screen size, default from framebuffer\n"
+	       "  -D [a,b,c,d,e,f]		distortion x'=ax+by+c y'=dx+ey+f (pixels)\n"
+	       "  -n [sigma]      			gaussian noise in pixels\n"
+	       "  -i [ms]         			interval between taps\n"
+	       "  -f [us]         			interval between reports of a tap\n"
+	       "  -k [frames]     			reports per tap\n"
+	       "  -w [ms]         			delay before the first tap\n"
+	       "  -b [count]      			flood motion reports before the taps, caltool discards them\n"
+	       "  -S [seed]       			noise seed\n"
+	       "  -p [layout]     			targets as given to caltool -p\n"
+	       "\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t start, elapsed;
+	unsigned int test;
+	double x, y, tx, ty;
+	int fd, c;
+
+	layout_parse(&layout, LAYOUT_DEFAULT);
+	while ((c = getopt(argc, argv, "vx:y:D:n:i:f:k:w:b:S:p:")) != -1) {
+		switch (c) {
+		case 'v':
+			printf("tsinject V%c.%c RELEASE %c build: %s %s\n", VERSION_MAJOR, VERSION_MINOR, VERSION_RELEASE, __DATE__, __TIME__);
+			exit(EXIT_FAILURE);
+		case 'x':
+			xres = atoi(optarg);
+			break;
+		case 'y':
+			yres = atoi(optarg);
+			break;
+		case 'D':
+			if (sscanf(optarg, "%lf,%lf,%lf,%lf,%lf,%lf",
+				   &distortion[0], &distortion[1], &distortion[2],
+				   &distortion[3], &distortion[4], &distortion[5]) != 6) {
+				printf("Error: -D needs six comma separated values !!\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'n':
+			noise = atof(optarg);
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'f':
+			frame_us = atoi(optarg);
+			break;
+		case 'k':
+			frames = atoi(optarg);
+			if (frames < 1)
+				frames = 1;
+			break;
+		case 'w':
+			delay_ms = atoi(optarg);
+			break;
+		case 'b':
+			burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			if (layout_parse(&layout, optarg) < 0) {
+				printf("Error: invalid layout !!\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	get_resolution();
+	if (xres <= 0 || yres <= 0) {
+		printf("Error: unknown screen size, use -x and -y !!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fd = open_uinput();
+	if (fd < 0)
+		exit(EXIT_FAILURE);
+
+	// give udev and caltool time to pick up the new device
+	sleep_usec(delay_ms * 1000UL);
+
+	start = monotonic_usec();
+
+	// caltool's dispatch statistics tell how fast it took these in
+	if (burst > 0) {
+		if (flood(fd, burst) < 0) {
+			ioctl(fd, UI_DEV_DESTROY);
+			close(fd);
+			exit(EXIT_FAILURE);
+		}
+		elapsed = monotonic_usec() - start;
+		printf("flood: %lu reports, %lu events written in %llu usec\n",
+		       burst, events_written, (unsigned long long)elapsed);
+		sleep_usec(interval_ms * 1000UL);
+		start = monotonic_usec();
+		events_written = 0;
+	}
+
+	for (test = 0; test < (unsigned int)layout.num; test++) {
+		// target as drawn by caltool, then distorted like a bad panel
+		tx = (int32_t)(layout.ratio[test].x_ratio * xres);
+		ty = (int32_t)(layout.ratio[test].y_ratio * yres);
+		x = distortion[0] * tx + distortion[1] * ty + distortion[2];
+		y = distortion[3] * tx + distortion[4] * ty + distortion[5];
+
+		if (tap(fd, x, y, test + 1))
+			break;
+		printf("tap %u: target %.0f,%.0f touched %.2f,%.2f\n", test, tx, ty, x, y);
+
+		sleep_usec(interval_ms * 1000UL);
+	}
+	elapsed = monotonic_usec() - start;
+	printf("session: %u taps, %lu events in %llu usec\n",
+	       test, events_written, (unsigned long long)elapsed);
+
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	return 0;
+}